@@ -0,0 +1,217 @@
+// -*- eval: (google-set-c-style) -*-
+
+// Microbenchmarks of the scoring kernels and of the choices of every turn,
+// for several numbers of colors and positions, with Google Benchmark:
+//   cmake --build build && build/mastermind-bench
+//   cmake --build build --target bench-json  (writes bench.json, to compare
+//   commits)
+// All games use one thread and a score table when it takes at most 64MB,
+// like the interactive program, so that the numbers are comparable across
+// machines with different numbers of cores. Only BM_ChooseIntentThreads,
+// for the speedup of the parallel search, and BM_ChooseIntentEngine, for
+// the vectors against the bitsets, deviate from that.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <benchmark/benchmark.h>
+
+#include "mastermind.h"
+
+namespace {
+
+const size_t kScoreTableBudget = 64 << 20;
+
+// The (colors, positions) of all benchmarks
+void Configurations(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"colors", "positions"});
+  for (auto& configuration:
+           vector<pair<int, int>>{{6, 4}, {8, 4}, {6, 5}, {8, 5}})
+    benchmark->Args({configuration.first, configuration.second});
+}
+
+// The game of num_colors and num_positions after the given number of turns
+// against a fixed secret, with the engine and with or without a score
+// table. The games are built once for all benchmarks.
+const MasterMind& Game(int num_colors, int num_positions, int turns,
+                       MasterMind::Engine engine, bool score_table) {
+  static map<tuple<int, int, int, MasterMind::Engine, bool>,
+             unique_ptr<MasterMind>> games;
+  unique_ptr<MasterMind>& game = games[make_tuple(
+      num_colors, num_positions, turns, engine, score_table)];
+  if (!game) {
+    game.reset(new MasterMind(string("rgbyopcmwk").substr(0, num_colors),
+                              num_positions, engine));
+    game->set_num_threads(1);
+    if (score_table)
+      game->set_score_table(game->BuildScoreTable(kScoreTableBudget));
+    MasterMind::ColorComb secret = *(game->target_candidates_begin() +
+                                     game->num_candidates() / 3);
+    MasterMind::ColorComb intent =
+        game->InitialIntent(game->ChooseInitialIntent());
+    for (int turn = 0; turn < turns; turn++) {
+      auto bw = game->Evaluate(secret, intent);
+      game->Update(intent, bw.first, bw.second);
+      intent = game->ChooseIntent();
+    }
+  }
+  return *game;
+}
+
+// The game of the colors and positions of state
+const MasterMind& Game(const benchmark::State& state, int turns = 0) {
+  return Game(state.range(0), state.range(1), turns,
+              MasterMind::Engine::kVectors, true);
+}
+
+// Some combinations spread over all of them
+vector<MasterMind::ColorComb> SomeCodes(const MasterMind& game, int n) {
+  vector<MasterMind::ColorComb> codes;
+  size_t step = max<size_t>(1, game.num_candidates() / n);
+  for (auto it = game.target_candidates_begin();
+       it < game.target_candidates_end(); it += step)
+    codes.push_back(*it);
+  return codes;
+}
+
+void BM_Evaluate(benchmark::State& state) {
+  const MasterMind& game = Game(state);
+  vector<MasterMind::ColorComb> codes = SomeCodes(game, 64);
+  size_t i = 0, j = 1;
+  for (auto _: state) {
+    benchmark::DoNotOptimize(game.Evaluate(codes[i], codes[j]));
+    if (++j == codes.size()) {
+      j = 0;
+      if (++i == codes.size())
+        i = 0;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Evaluate)->Apply(Configurations);
+
+// Scores an intent against all possible targets
+void BM_Entropy(benchmark::State& state) {
+  const MasterMind& game = Game(state);
+  vector<MasterMind::ColorComb> intents = SomeCodes(game, 16);
+  size_t i = 0;
+  for (auto _: state) {
+    benchmark::DoNotOptimize(game.Entropy(intents[i]));
+    i = (i + 1) % intents.size();
+  }
+  state.SetItemsProcessed(state.iterations() * game.num_candidates());
+}
+BENCHMARK(BM_Entropy)->Apply(Configurations);
+
+// The first Update of a game, and its Undo
+void BM_Update(benchmark::State& state) {
+  MasterMind game(Game(state));
+  MasterMind::ColorComb intent =
+      game.InitialIntent(game.ChooseInitialIntent());
+  MasterMind::ColorComb secret = SomeCodes(game, 3)[1];
+  auto bw = game.Evaluate(secret, intent);
+  for (auto _: state) {
+    game.Update(intent, bw.first, bw.second);
+    game.Undo();
+  }
+  state.SetItemsProcessed(state.iterations() * game.num_candidates());
+}
+BENCHMARK(BM_Update)->Apply(Configurations);
+
+void BM_IntentClass(benchmark::State& state) {
+  const MasterMind& game = Game(state, 1);
+  vector<MasterMind::ColorComb> intents = SomeCodes(game, 64);
+  size_t i = 0;
+  for (auto _: state) {
+    benchmark::DoNotOptimize(game.IntentClass(intents[i]));
+    i = (i + 1) % intents.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IntentClass)->Apply(Configurations);
+
+void BM_ChooseInitialIntent(benchmark::State& state) {
+  const MasterMind& game = Game(state);
+  for (auto _: state)
+    benchmark::DoNotOptimize(game.ChooseInitialIntent());
+}
+BENCHMARK(BM_ChooseInitialIntent)->Apply(Configurations)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_Choose2ndIntent(benchmark::State& state) {
+  const MasterMind& game = Game(state, 1);
+  for (auto _: state)
+    benchmark::DoNotOptimize(game.Choose2ndIntent());
+  state.counters["targets"] = game.num_candidates();
+}
+BENCHMARK(BM_Choose2ndIntent)->Apply(Configurations)
+    ->Unit(benchmark::kMillisecond);
+
+// The third turn
+void BM_ChooseIntent(benchmark::State& state) {
+  const MasterMind& game = Game(state, 2);
+  for (auto _: state)
+    benchmark::DoNotOptimize(game.ChooseIntent());
+  state.counters["targets"] = game.num_candidates();
+}
+BENCHMARK(BM_ChooseIntent)->Apply(Configurations)
+    ->Unit(benchmark::kMillisecond);
+
+// The third turn on 1, 2, 4, .. threads, up to all cores
+void BM_ChooseIntentThreads(benchmark::State& state) {
+  MasterMind game(Game(state, 2));
+  game.set_num_threads(state.range(2));
+  for (auto _: state)
+    benchmark::DoNotOptimize(game.ChooseIntent());
+  state.counters["targets"] = game.num_candidates();
+}
+void ThreadConfigurations(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"colors", "positions", "threads"});
+  int max_threads = max(1u, thread::hardware_concurrency());
+  for (auto& configuration: vector<pair<int, int>>{{6, 4}, {8, 5}})
+    for (int threads = 1; ; threads = min(2 * threads, max_threads)) {
+      benchmark->Args({configuration.first, configuration.second, threads});
+      if (threads == max_threads)
+        break;
+    }
+}
+BENCHMARK(BM_ChooseIntentThreads)->Apply(ThreadConfigurations)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The third turn with the vectors and with the bitsets, without a score
+// table for the vectors. Skipped for the bitsets when their partition masks
+// don't fit in the budget.
+void BM_ChooseIntentEngine(benchmark::State& state) {
+  auto engine = static_cast<MasterMind::Engine>(state.range(2));
+  const MasterMind& game = Game(state.range(0), state.range(1), 2, engine,
+                                false);
+  if (game.engine() != engine) {
+    state.SkipWithError("the partition masks don't fit in the budget");
+    return;
+  }
+  for (auto _: state)
+    benchmark::DoNotOptimize(game.ChooseIntent());
+  state.counters["targets"] = game.num_candidates();
+}
+void EngineConfigurations(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ArgNames({"colors", "positions", "engine"});
+  for (auto& configuration:
+           vector<pair<int, int>>{{6, 4}, {8, 5}, {8, 6}})
+    for (auto engine: {MasterMind::Engine::kVectors,
+                       MasterMind::Engine::kBitsets})
+      benchmark->Args({configuration.first, configuration.second,
+                       static_cast<int>(engine)});
+}
+BENCHMARK(BM_ChooseIntentEngine)->Apply(EngineConfigurations)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,137 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+using namespace std;
+
+#include "cache.h"
+
+// Bump when the layout changes, so that old files are ignored.
+static const uint32_t kCacheVersion = 2;
+static const char kCacheMagic[8] = "MMCACHE";
+
+// The file consists of the header, the slots of the opening book, and the
+// score table at table_offset, aligned to a cache line. All numbers are in
+// native byte order.
+struct GameCache::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_colors;
+  uint32_t num_positions;
+  uint32_t padding;
+  uint64_t initial_intent;
+  uint64_t book_offset;
+  uint64_t book_slots;
+  // 0 if there is no table
+  uint64_t table_offset;
+  uint64_t table_size;
+};
+
+string GameCache::Path(int num_colors, int num_positions) {
+  const char* dir = getenv("MASTERMIND_CACHE_DIR");
+  char name[64];
+  snprintf(name, sizeof(name), "mastermind-%dx%d.cache",
+           num_colors, num_positions);
+  return (dir && *dir ? string(dir) + "/" : string()) + name;
+}
+
+bool GameCache::Build(const MasterMind& game, const string& path,
+                      size_t table_budget, int book_depth) {
+  MasterMind base(game);
+  shared_ptr<const ScoreTable> table = base.BuildScoreTable(table_budget);
+  if (table)
+    base.set_score_table(table);
+  shared_ptr<const OpeningBook> book = OpeningBook::Build(base, book_depth);
+
+  Header header;
+  memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+  header.version = kCacheVersion;
+  header.num_colors = game.colors().size();
+  header.num_positions = game.num_positions();
+  header.padding = 0;
+  header.initial_intent = book->initial_intent();
+  header.book_offset = sizeof(Header);
+  header.book_slots = book->num_slots();
+  uint64_t end =
+      header.book_offset + book->num_slots() * sizeof(OpeningBook::Entry);
+  header.table_offset = table ? (end + 63) / 64 * 64 : 0;
+  header.table_size = table ? table->num_codes * table->num_codes : 0;
+
+  // Write to a temporary file and rename it, so that processes starting
+  // meanwhile never map a partial file.
+  string tmp_path = path + ".tmp";
+  {
+    ofstream out(tmp_path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(book->slots()),
+              book->num_slots() * sizeof(OpeningBook::Entry));
+    if (table) {
+      string padding(header.table_offset - end, '\0');
+      out.write(padding.data(), padding.size());
+      out.write(reinterpret_cast<const char*>(table->results),
+                header.table_size);
+    }
+    if (!out)
+      return false;
+  }
+  return rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+shared_ptr<const GameCache> GameCache::Load(const string& path,
+                                            const MasterMind& game) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Header)) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+
+  shared_ptr<GameCache> cache(new GameCache);
+  cache->mapping_ = shared_ptr<const void>(
+      data, [size](const void* p) { munmap(const_cast<void*>(p), size); });
+  const char* bytes = static_cast<const char*>(data);
+  const Header* header = reinterpret_cast<const Header*>(bytes);
+  if (memcmp(header->magic, kCacheMagic, sizeof(header->magic)) != 0 ||
+      header->version != kCacheVersion ||
+      header->num_colors != game.colors().size() ||
+      header->num_positions != uint32_t(game.num_positions()) ||
+      header->book_offset + header->book_slots * sizeof(OpeningBook::Entry) >
+          size ||
+      header->table_offset + header->table_size > size)
+    return nullptr;
+  auto mapping = cache->mapping_;
+  cache->book_ = shared_ptr<const OpeningBook>(
+      new OpeningBook(header->initial_intent,
+                      reinterpret_cast<const OpeningBook::Entry*>(
+                          bytes + header->book_offset),
+                      header->book_slots),
+      [mapping](const OpeningBook* book) { delete book; });
+
+  if (header->table_offset != 0) {
+    auto table = make_shared<ScoreTable>();
+    table->num_colors = header->num_colors;
+    table->num_positions = header->num_positions;
+    table->num_codes = game.num_codes();
+    if (table->num_codes * table->num_codes != header->table_size)
+      return nullptr;
+    table->results =
+        reinterpret_cast<const uint8_t*>(bytes + header->table_offset);
+    table->storage = cache->mapping_;
+    cache->score_table_ = table;
+  }
+  return cache;
+}
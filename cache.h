@@ -0,0 +1,55 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mastermind.h"
+#include "opening_book.h"
+
+// A file with data precomputed for a number of colors and positions (the
+// actual colors don't matter), so that processes don't have to compute them
+// at startup:
+// - the opening book, starting with the intent chosen by ChooseInitialIntent
+// - optionally the score table
+// The file is memory mapped read-only, so that processes using the same
+// file share its pages, and the book and score table are used in place.
+class GameCache {
+ public:
+  // The file name used for a number of colors and positions, in the
+  // directory $MASTERMIND_CACHE_DIR, or else the current one.
+  static std::string Path(int num_colors, int num_positions);
+
+  // Computes the data for the game (which should be in its initial state)
+  // and writes them to path. The opening book is book_depth replies deep,
+  // and the score table is only included if it takes at most table_budget
+  // bytes. Returns false if the file can't be written.
+  static bool Build(const MasterMind& game, const std::string& path,
+                    size_t table_budget, int book_depth);
+
+  // Maps the file at path. Returns null if it doesn't exist, isn't a cache
+  // of the current version, or is for different numbers of colors and
+  // positions than the game.
+  static std::shared_ptr<const GameCache> Load(const std::string& path,
+                                               const MasterMind& game);
+
+  std::shared_ptr<const OpeningBook> book() const { return book_; }
+
+  // Null if the file doesn't contain a score table.
+  std::shared_ptr<const ScoreTable> score_table() const { return score_table_; }
+
+ private:
+  struct Header;
+
+  GameCache() = default;
+
+  // unmaps the file when the last user is gone, which may be the book or
+  // the score table
+  std::shared_ptr<const void> mapping_;
+  std::shared_ptr<const OpeningBook> book_;
+  std::shared_ptr<const ScoreTable> score_table_;
+};
+
+#endif // CACHE_H_
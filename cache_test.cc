@@ -0,0 +1,49 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "cache.h"
+#include "mastermind.h"
+
+namespace {
+
+TEST(GameCacheTest, BuildAndLoad) {
+  char directory[] = "/tmp/mastermind_test.XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(directory));
+  string path = string(directory) + "/mastermind-6x4.cache";
+  MasterMind game("rgbyop", 4);
+  EXPECT_EQ(nullptr, GameCache::Load(path, game));
+  ASSERT_TRUE(GameCache::Build(game, path, 64 << 20, 1));
+
+  auto cache = GameCache::Load(path, game);
+  ASSERT_NE(nullptr, cache);
+  ASSERT_NE(nullptr, cache->book());
+  EXPECT_EQ(game.ChooseInitialIntent(),
+            cache->book()->initial_partition(game.num_positions()));
+  // the table must give the evaluations
+  MasterMind looked_up(game);
+  ASSERT_NE(nullptr, cache->score_table());
+  looked_up.set_score_table(cache->score_table());
+  MasterMind::ColorComb intent = game.string2cc("rrgb");
+  EXPECT_EQ(game.Entropy(intent), looked_up.Entropy(intent));
+  game.Update(intent, 1, 1);
+  looked_up.Update(intent, 1, 1);
+  EXPECT_EQ(game.ChooseIntent(), looked_up.ChooseIntent());
+
+  // only for the same numbers of colors and positions
+  EXPECT_NE(nullptr, GameCache::Load(path, MasterMind("012345", 4)));
+  EXPECT_EQ(nullptr, GameCache::Load(path, MasterMind("rgbyo", 4)));
+  EXPECT_EQ(nullptr, GameCache::Load(path, MasterMind("rgbyop", 5)));
+
+  cache.reset();
+  unlink(path.c_str());
+  rmdir(directory);
+}
+
+}  // namespace
@@ -0,0 +1,185 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+using namespace std;
+
+#include "constraints.h"
+
+Constraints::Constraints(int num_colors, int num_positions)
+    : num_colors_(num_colors), num_positions_(num_positions) {
+  Derive();
+}
+
+void Constraints::Add(uint64_t intent, int black, int white) {
+  Evaluation evaluation = {};
+  for (int i = 0; i < num_positions_; i++) {
+    int color = (intent >> (4 * (num_positions_ - 1 - i))) & 0xF;
+    evaluation.colors[i] = color;
+    evaluation.counts[color]++;
+  }
+  evaluation.black = black;
+  evaluation.common = black + white;
+  evaluations_.push_back(evaluation);
+  Derive();
+}
+
+void Constraints::RemoveLast() {
+  evaluations_.pop_back();
+  Derive();
+}
+
+void Constraints::Derive() {
+  int n = num_positions_;
+  uint32_t all_colors = (uint32_t(1) << num_colors_) - 1;
+  fill(allowed_colors_, allowed_colors_ + n, all_colors);
+  fill(min_counts_, min_counts_ + num_colors_, 0);
+  fill(max_counts_, max_counts_ + num_colors_, n);
+  for (auto& evaluation: evaluations_) {
+    for (int i = 0; i < n; i++) {
+      uint32_t color_bit = uint32_t(1) << evaluation.colors[i];
+      if (evaluation.black == 0)
+        allowed_colors_[i] &= ~color_bit;
+      else if (evaluation.black == n)
+        allowed_colors_[i] &= color_bit;
+    }
+    for (int c = 0; c < num_colors_; c++) {
+      int count = evaluation.counts[c];
+      if (count == 0) {
+        // the common colors are all colors of the intent
+        max_counts_[c] = min(max_counts_[c], n - evaluation.common);
+        continue;
+      }
+      // min(count of the target, count) common colors of this one, and
+      // at most n - count of the others
+      min_counts_[c] = max(min_counts_[c], evaluation.common - (n - count));
+      if (count > evaluation.common)
+        max_counts_[c] = min(max_counts_[c], evaluation.common);
+    }
+  }
+
+  // Combine them until they don't change. Every step only lowers an upper
+  // bound, raises a lower bound or removes an allowed color, so this ends,
+  // unless the bounds contradict each other, which no code can satisfy.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    int sum_min = 0, sum_max = 0;
+    for (int c = 0; c < num_colors_; c++) {
+      sum_min += min_counts_[c];
+      sum_max += max_counts_[c];
+    }
+    for (int c = 0; c < num_colors_; c++) {
+      int positions = 0;
+      for (int i = 0; i < n; i++)
+        positions += (allowed_colors_[i] >> c) & 1;
+      int max_count = min({max_counts_[c], positions,
+                           n - (sum_min - min_counts_[c])});
+      int min_count = max(min_counts_[c], n - (sum_max - max_counts_[c]));
+      if (max_count != max_counts_[c] || min_count != min_counts_[c]) {
+        max_counts_[c] = max_count;
+        min_counts_[c] = min_count;
+        changed = true;
+      }
+      if (min_counts_[c] > max_counts_[c]) {
+        fill(allowed_colors_, allowed_colors_ + n, 0);
+        return;
+      }
+      if (max_counts_[c] == 0) {
+        for (int i = 0; i < n; i++) {
+          if ((allowed_colors_[i] >> c) & 1) {
+            allowed_colors_[i] &= ~(uint32_t(1) << c);
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+bool Constraints::Admits(uint64_t code) const {
+  int counts[16] = {};
+  int colors[16];
+  for (int i = 0; i < num_positions_; i++) {
+    colors[i] = (code >> (4 * (num_positions_ - 1 - i))) & 0xF;
+    if (!((allowed_colors_[i] >> colors[i]) & 1))
+      return false;
+    counts[colors[i]]++;
+  }
+  for (int c = 0; c < num_colors_; c++)
+    if (counts[c] < min_counts_[c] || counts[c] > max_counts_[c])
+      return false;
+  for (auto& evaluation: evaluations_) {
+    int black = 0, common = 0;
+    for (int i = 0; i < num_positions_; i++)
+      black += colors[i] == evaluation.colors[i];
+    for (int c = 0; c < num_colors_; c++)
+      common += min(counts[c], evaluation.counts[c]);
+    if (black != evaluation.black || common != evaluation.common)
+      return false;
+  }
+  return true;
+}
+
+void Constraints::Generate(uint64_t prefix, int prefix_length,
+                           vector<uint64_t>* codes) const {
+  int n = num_positions_;
+  int num_evaluations = evaluations_.size();
+  // The state of the colors placed so far: their counts, the number of
+  // colors still needed to reach the lower bounds, and the blacks and
+  // common colors with every intent.
+  int counts[16] = {};
+  int deficit = 0;
+  for (int c = 0; c < num_colors_; c++)
+    deficit += max(0, min_counts_[c]);
+  vector<int> blacks(num_evaluations, 0), commons(num_evaluations, 0);
+
+  // Places color at position i, and returns false if that makes reaching
+  // all evaluations impossible. remove undoes it in either case.
+  auto place = [&](int i, int color) {
+    bool possible = ((allowed_colors_[i] >> color) & 1) &&
+        counts[color] < max_counts_[color];
+    deficit -= counts[color] < min_counts_[color];
+    counts[color]++;
+    int left = n - 1 - i;
+    possible = possible && deficit <= left;
+    for (int e = 0; e < num_evaluations; e++) {
+      const Evaluation& evaluation = evaluations_[e];
+      blacks[e] += evaluation.colors[i] == color;
+      commons[e] += counts[color] <= evaluation.counts[color];
+      possible = possible &&
+          blacks[e] <= evaluation.black &&
+          blacks[e] + left >= evaluation.black &&
+          commons[e] <= evaluation.common &&
+          commons[e] + left >= evaluation.common;
+    }
+    return possible;
+  };
+  auto remove = [&](int i, int color) {
+    for (int e = 0; e < num_evaluations; e++) {
+      const Evaluation& evaluation = evaluations_[e];
+      blacks[e] -= evaluation.colors[i] == color;
+      commons[e] -= counts[color] <= evaluation.counts[color];
+    }
+    counts[color]--;
+    deficit += counts[color] < min_counts_[color];
+  };
+
+  bool possible = true;
+  for (int i = 0; i < prefix_length; i++)
+    possible = place(i, (prefix >> (4 * (prefix_length - 1 - i))) & 0xF) &&
+        possible;
+  if (!possible)
+    return;
+  auto search = [&](int i, uint64_t code, auto& search) {
+    if (i == n) {
+      codes->push_back(code);
+      return;
+    }
+    for (int color = 0; color < num_colors_; color++) {
+      if (place(i, color))
+        search(i + 1, (code << 4) | color, search);
+      remove(i, color);
+    }
+  };
+  search(prefix_length, prefix, search);
+}
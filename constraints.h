@@ -0,0 +1,77 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef CONSTRAINTS_H_
+#define CONSTRAINTS_H_
+
+#include <cstdint>
+#include <vector>
+
+// What the evaluations of a game so far say about the target, for codes
+// packed like MasterMind::ColorComb (one 4-bit color index per position,
+// position 0 in the most significant nibble used).
+//
+// Every evaluation (intent, black, white) is kept, together with what they
+// imply for single positions and colors: the colors allowed at every
+// position, and bounds of the number of times every color occurs. E.g. no
+// black excludes the color of the intent at every position, and black +
+// white common colors bound the count of a color by the number of common
+// colors if the intent has more of it, and from below by what the other
+// colors of the intent can't account for. These are combined until they
+// don't change, e.g. a color no position allows can't occur.
+//
+// Generate enumerates the codes that get all evaluations by a depth first
+// search over the positions, which is pruned by the allowed colors and
+// the bounds, and by the numbers of blacks and common colors every intent
+// has with the colors placed so far, which must be reachable with the
+// positions left. These are only necessary conditions, so it may still
+// visit prefixes no consistent code starts with, but at the last position
+// they become exact: the blacks and common colors of every intent must
+// equal its evaluation, so every code it reaches gets all evaluations
+// without being scored.
+class Constraints {
+ public:
+  Constraints(int num_colors, int num_positions);
+
+  // Adds the evaluation of intent and what it implies.
+  void Add(uint64_t intent, int black, int white);
+  // Removes the last evaluation added.
+  void RemoveLast();
+  size_t size() const { return evaluations_.size(); }
+
+  // The colors allowed at position, as a bitmask of color indices
+  uint32_t allowed_colors(int position) const {
+    return allowed_colors_[position];
+  }
+  // Bounds of the number of times color occurs in the target
+  int min_count(int color) const { return min_counts_[color]; }
+  int max_count(int color) const { return max_counts_[color]; }
+
+  // Whether code gets all evaluations
+  bool Admits(uint64_t code) const;
+
+  // Appends the codes that get all evaluations and start with the colors
+  // of the prefix_length positions of prefix (which holds them in its
+  // lowest nibbles, like a code of prefix_length positions) to *codes, in
+  // increasing order.
+  void Generate(uint64_t prefix, int prefix_length,
+                std::vector<uint64_t>* codes) const;
+
+ private:
+  struct Evaluation {
+    int colors[16];  // by position
+    int counts[16];  // by color
+    int black;
+    int common;
+  };
+
+  // Sets the allowed colors and bounds from evaluations_
+  void Derive();
+
+  int num_colors_;
+  int num_positions_;
+  std::vector<Evaluation> evaluations_;
+  uint32_t allowed_colors_[16];
+  int min_counts_[16];
+  int max_counts_[16];
+};
+
+#endif // CONSTRAINTS_H_
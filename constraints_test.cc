@@ -0,0 +1,87 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <random>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "constraints.h"
+#include "mastermind.h"
+
+namespace {
+
+// Along games against random targets with random intents, the codes
+// Generate gives must be exactly those that get all evaluations, and they
+// must satisfy the allowed colors and bounds.
+void CheckGenerate(const string& colors, int num_positions) {
+  MasterMind game(colors, num_positions);
+  vector<MasterMind::ColorComb> codes(game.target_candidates_begin(),
+                                      game.target_candidates_end());
+  mt19937 random(colors.size() * 100 + num_positions);
+  for (int t = 0; t < 20; t++) {
+    MasterMind::ColorComb target = codes[random() % codes.size()];
+    Constraints constraints(colors.size(), num_positions);
+    vector<MasterMind::ColorComb> consistent(codes);
+    for (int turn = 0; turn < 3; turn++) {
+      MasterMind::ColorComb intent = codes[random() % codes.size()];
+      auto bw = game.Evaluate(target, intent);
+      constraints.Add(intent, bw.first, bw.second);
+      vector<MasterMind::ColorComb> left;
+      for (auto code: consistent)
+        if (game.Evaluate(code, intent) == bw)
+          left.push_back(code);
+      consistent.swap(left);
+
+      vector<uint64_t> generated;
+      constraints.Generate(0, 0, &generated);
+      ASSERT_EQ(consistent, generated) << game.cc2string(intent) << " "
+                                       << bw.first << " " << bw.second;
+      for (auto code: consistent) {
+        EXPECT_TRUE(constraints.Admits(code));
+        MasterMind::ColorCounts counts = game.CountColors(code);
+        for (size_t c = 0; c < colors.size(); c++) {
+          EXPECT_GE(int((counts >> (4 * c)) & 0xF), constraints.min_count(c));
+          EXPECT_LE(int((counts >> (4 * c)) & 0xF), constraints.max_count(c));
+        }
+        for (int i = 0; i < num_positions; i++)
+          EXPECT_TRUE((constraints.allowed_colors(i) >> game.Color(code, i)) &
+                      1);
+      }
+      // the same codes, starting with every color
+      vector<uint64_t> by_prefix;
+      for (size_t c = 0; c < colors.size(); c++)
+        constraints.Generate(c, 1, &by_prefix);
+      EXPECT_EQ(generated, by_prefix);
+    }
+    for (int turn = 0; turn < 3; turn++)
+      constraints.RemoveLast();
+    EXPECT_EQ(0u, constraints.size());
+    EXPECT_EQ(num_positions, constraints.max_count(0));
+  }
+}
+
+TEST(ConstraintsTest, Generate) {
+  CheckGenerate("rgbyop", 4);
+  CheckGenerate("rgbyopcm", 5);
+}
+
+TEST(ConstraintsTest, Bounds) {
+  MasterMind game("rgbyop", 4);
+  Constraints constraints(6, 4);
+  // no r or g, and no b or y where they were
+  constraints.Add(game.string2cc("rrgg"), 0, 0);
+  constraints.Add(game.string2cc("bbyy"), 0, 3);
+  EXPECT_EQ(0, constraints.max_count(0));
+  EXPECT_EQ(0, constraints.max_count(1));
+  // b and y make up at least 3 of the colors, so at most 1 is o or p
+  EXPECT_EQ(1, constraints.min_count(2));
+  EXPECT_EQ(2, constraints.max_count(2));
+  EXPECT_EQ(1, constraints.max_count(4));
+  EXPECT_EQ(0x38u, constraints.allowed_colors(0));
+  EXPECT_EQ(0x34u, constraints.allowed_colors(2));
+  EXPECT_FALSE(constraints.Admits(game.string2cc("yybb")));
+  EXPECT_TRUE(constraints.Admits(game.string2cc("yobb")));
+}
+
+}  // namespace
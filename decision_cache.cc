@@ -0,0 +1,77 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+using namespace std;
+
+#include "decision_cache.h"
+
+DecisionCache::DecisionCache(size_t capacity)
+    : shards_(new Shard[kNumShards]),
+      shard_capacity_(max<size_t>(1, (capacity + kNumShards - 1) / kNumShards)),
+      hits_(0), misses_(0), evictions_(0) {
+  for (int s = 0; s < kNumShards; s++) {
+    shards_[s].slots.reserve(shard_capacity_);
+    shards_[s].index.reserve(shard_capacity_);
+  }
+}
+
+bool DecisionCache::Find(const Key& key, uint64_t* intent) {
+  Shard& shard = ShardOf(key);
+  {
+    lock_guard<mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      Slot& slot = shard.slots[it->second];
+      slot.referenced = true;
+      *intent = slot.intent;
+      hits_.fetch_add(1, memory_order_relaxed);
+      return true;
+    }
+  }
+  misses_.fetch_add(1, memory_order_relaxed);
+  return false;
+}
+
+void DecisionCache::Insert(const Key& key, uint64_t intent) {
+  Shard& shard = ShardOf(key);
+  lock_guard<mutex> lock(shard.mutex);
+  if (shard.index.count(key))
+    return;
+  if (shard.slots.size() < shard_capacity_) {
+    shard.index.emplace(key, shard.slots.size());
+    shard.slots.push_back(Slot{key, intent, false});
+    return;
+  }
+  // Give the referenced slots a second chance, up to a full circle
+  while (shard.slots[shard.hand].referenced) {
+    shard.slots[shard.hand].referenced = false;
+    shard.hand = (shard.hand + 1) % shard.slots.size();
+  }
+  Slot& victim = shard.slots[shard.hand];
+  shard.index.erase(victim.key);
+  victim = Slot{key, intent, false};
+  shard.index.emplace(key, shard.hand);
+  shard.hand = (shard.hand + 1) % shard.slots.size();
+  evictions_.fetch_add(1, memory_order_relaxed);
+}
+
+size_t DecisionCache::capacity() const {
+  return shard_capacity_ * kNumShards;
+}
+
+size_t DecisionCache::size() const {
+  size_t size = 0;
+  for (int s = 0; s < kNumShards; s++) {
+    lock_guard<mutex> lock(shards_[s].mutex);
+    size += shards_[s].index.size();
+  }
+  return size;
+}
+
+DecisionCache::Stats DecisionCache::stats() const {
+  Stats stats;
+  stats.hits = hits_.load(memory_order_relaxed);
+  stats.misses = misses_.load(memory_order_relaxed);
+  stats.evictions = evictions_.load(memory_order_relaxed);
+  return stats;
+}
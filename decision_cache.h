@@ -0,0 +1,83 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef DECISION_CACHE_H_
+#define DECISION_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// The intents chosen in states seen before, shared by all games using the
+// cache (see MasterMind::set_decision_cache), which may be on different
+// threads. When many games are played, most states after the first turns
+// are repeats.
+//
+// It holds at most a fixed number of entries. When it is full, an entry
+// is evicted by the CLOCK algorithm: entries are visited in a circle, and
+// the first one that hasn't been found since the last visit is replaced,
+// which approximates evicting the least recently used one. The entries are
+// spread over shards with a lock each, so that threads rarely wait.
+class DecisionCache {
+ public:
+  // A state: a 128 bit hash of the possible targets and of what else the
+  // choice depends on, so that collisions can be ignored.
+  struct Key {
+    uint64_t hash[2];
+    bool operator==(const Key& other) const {
+      return hash[0] == other.hash[0] && hash[1] == other.hash[1];
+    }
+  };
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  // Holds up to capacity entries (at least one per shard).
+  explicit DecisionCache(size_t capacity);
+
+  // Sets *intent to the one stored for key and returns true, or returns
+  // false if there is none.
+  bool Find(const Key& key, uint64_t* intent);
+  // Stores intent for key, unless there already is one.
+  void Insert(const Key& key, uint64_t intent);
+
+  size_t capacity() const;
+  size_t size() const;
+  Stats stats() const;
+
+ private:
+  static const int kNumShards = 16;
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const { return key.hash[1]; }
+  };
+
+  struct Slot {
+    Key key;
+    uint64_t intent;
+    // found since the clock hand passed
+    bool referenced;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // the slots in use are the first index.size() ones
+    std::vector<Slot> slots;
+    std::unordered_map<Key, size_t, KeyHash> index;
+    size_t hand = 0;
+  };
+
+  Shard& ShardOf(const Key& key) {
+    return shards_[key.hash[0] % kNumShards];
+  }
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_capacity_;
+  std::atomic<uint64_t> hits_, misses_, evictions_;
+};
+
+#endif // DECISION_CACHE_H_
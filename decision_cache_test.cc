@@ -0,0 +1,131 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <memory>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "decision_cache.h"
+#include "mastermind.h"
+
+namespace {
+
+DecisionCache::Key MakeKey(uint64_t i) {
+  return DecisionCache::Key{{i * 0x9e3779b97f4a7c15, ~i}};
+}
+
+TEST(DecisionCacheTest, FindAndInsert) {
+  DecisionCache cache(1024);
+  uint64_t intent;
+  EXPECT_FALSE(cache.Find(MakeKey(1), &intent));
+  cache.Insert(MakeKey(1), 0x123);
+  ASSERT_TRUE(cache.Find(MakeKey(1), &intent));
+  EXPECT_EQ(0x123u, intent);
+  // the first intent stays
+  cache.Insert(MakeKey(1), 0x456);
+  ASSERT_TRUE(cache.Find(MakeKey(1), &intent));
+  EXPECT_EQ(0x123u, intent);
+  EXPECT_EQ(1u, cache.size());
+  DecisionCache::Stats stats = cache.stats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(0u, stats.evictions);
+}
+
+TEST(DecisionCacheTest, Eviction) {
+  DecisionCache cache(64);
+  for (uint64_t i = 0; i < 1000; i++)
+    cache.Insert(MakeKey(i), i);
+  EXPECT_EQ(cache.capacity(), cache.size());
+  EXPECT_EQ(1000 - cache.capacity(), cache.stats().evictions);
+  // the entries left are correct
+  int found = 0;
+  for (uint64_t i = 0; i < 1000; i++) {
+    uint64_t intent;
+    if (cache.Find(MakeKey(i), &intent)) {
+      EXPECT_EQ(i, intent);
+      found++;
+    }
+  }
+  EXPECT_EQ(cache.capacity(), size_t(found));
+}
+
+// An entry found since the clock passed it survives the next eviction of
+// its shard, instead of an older one that wasn't
+TEST(DecisionCacheTest, SecondChance) {
+  // two entries per shard
+  DecisionCache cache(32);
+  vector<uint64_t> same_shard;
+  for (uint64_t i = 0; same_shard.size() < 3; i++)
+    if (MakeKey(i).hash[0] % 16 == MakeKey(0).hash[0] % 16)
+      same_shard.push_back(i);
+  cache.Insert(MakeKey(same_shard[0]), 1);
+  cache.Insert(MakeKey(same_shard[1]), 2);
+  uint64_t intent;
+  ASSERT_TRUE(cache.Find(MakeKey(same_shard[0]), &intent));
+  cache.Insert(MakeKey(same_shard[2]), 3);
+  EXPECT_TRUE(cache.Find(MakeKey(same_shard[0]), &intent));
+  EXPECT_FALSE(cache.Find(MakeKey(same_shard[1]), &intent));
+  EXPECT_TRUE(cache.Find(MakeKey(same_shard[2]), &intent));
+  EXPECT_EQ(1u, cache.stats().evictions);
+}
+
+// Twice for every pair of evaluations of the initial intent and the reply,
+// and every strategy, the intents must be those computed without cache,
+// with a cache that is too small to hold all states, so that some are
+// evicted, and with one that holds them, so that the second time they are
+// all found.
+TEST(DecisionCacheTest, SameIntents) {
+  MasterMind plain("rgbyop", 4);
+  plain.set_score_table(plain.BuildScoreTable(64 << 20));
+  MasterMind::ColorComb intent =
+      plain.InitialIntent(plain.ChooseInitialIntent());
+  int num_positions = plain.num_positions();
+  for (size_t capacity: {size_t(64), size_t(1) << 16}) {
+    MasterMind cached(plain);
+    cached.set_decision_cache(make_shared<DecisionCache>(capacity));
+    uint64_t lookups = 0;
+    for (int round = 0; round < 2; round++) {
+      for (int k = 0; k < MasterMind::kNumStrategies; k++) {
+        plain.set_strategy(MasterMind::Strategy(k));
+        cached.set_strategy(MasterMind::Strategy(k));
+        for (int b1 = 0; b1 < num_positions; b1++) {
+          for (int w1 = 0; b1 + w1 <= num_positions; w1++) {
+            plain.Update(intent, b1, w1);
+            cached.Update(intent, b1, w1);
+            if (plain.num_candidates() > 1) {
+              MasterMind::ColorComb reply = plain.ChooseIntent();
+              lookups++;
+              EXPECT_EQ(reply, cached.ChooseIntent());
+              for (int b2 = 0; b2 < num_positions; b2++) {
+                for (int w2 = 0; b2 + w2 <= num_positions; w2++) {
+                  plain.Update(reply, b2, w2);
+                  cached.Update(reply, b2, w2);
+                  if (plain.num_candidates() > 1) {
+                    lookups++;
+                    EXPECT_EQ(plain.ChooseIntent(), cached.ChooseIntent());
+                  }
+                  plain.Undo();
+                  cached.Undo();
+                }
+              }
+            }
+            plain.Undo();
+            cached.Undo();
+          }
+        }
+      }
+    }
+    const DecisionCache& cache = *cached.decision_cache();
+    DecisionCache::Stats stats = cache.stats();
+    EXPECT_EQ(lookups, stats.hits + stats.misses);
+    EXPECT_LE(cache.size(), cache.capacity());
+    if (cache.capacity() >= lookups)
+      EXPECT_GE(stats.hits, lookups / 2);
+    else
+      EXPECT_GT(stats.evictions, 0u);
+  }
+}
+
+}  // namespace
@@ -0,0 +1,237 @@
+// -*- eval: (google-set-c-style) -*-
+
+// Load generator for the GameServer protocol (see server.h): plays games
+// against random secrets through a server in this process, keeping a
+// number of them in flight at the same time, and reports the throughput in
+// hints per second and the latency of the hints, from submitting the
+// request to receiving the response.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "mastermind.h"
+#include "cache.h"
+#include "decision_cache.h"
+#include "opening_book.h"
+#include "server.h"
+
+namespace {
+
+// Like the interactive program
+const size_t kScoreTableBudget = 64 << 20;
+// Like mastermind-sim
+const size_t kDecisionCacheSize = size_t(1) << 20;
+
+void usage() {
+  printf("Usage: mastermind-load [--strategy entropy|minimax|most-parts|"
+         "expected-size]\n"
+         "                       [--games n] [--concurrency n] "
+         "[--threads n] [--no-share]\n"
+         "                       [--hint-ms n] "
+         "colors positions\n"
+         "with 1 to %d distinct colors and 1 to %d positions\n",
+         MasterMind::kMaxColors, MasterMind::kMaxPositions);
+  exit(1);
+}
+
+// The games in flight, driven by the responses of the server
+class Clients {
+ public:
+  Clients(const MasterMind& game, size_t num_games)
+      : game_(game), num_games_(num_games), random_(1),
+        secrets_(game.target_candidates_begin(),
+                 game.target_candidates_end()) {}
+
+  void set_server(GameServer* server) { server_ = server; }
+
+  // Starts a game, if not all have been started
+  void Start() {
+    string id;
+    {
+      lock_guard<mutex> lock(mutex_);
+      if (num_started_ == num_games_)
+        return;
+      id = "g" + to_string(num_started_++);
+      Client& client = clients_[id];
+      client.secret = secrets_[random_() % secrets_.size()];
+      client.hint_time = chrono::steady_clock::now();
+    }
+    server_->Submit(id + " hint");
+  }
+
+  void Respond(const string& response) {
+    auto now = chrono::steady_clock::now();
+    istringstream in(response);
+    string id, kind, value;
+    in >> id >> kind >> value;
+    string request;
+    bool finished = false;
+    {
+      lock_guard<mutex> lock(mutex_);
+      Client& client = clients_.at(id);
+      if (kind == "hint") {
+        latencies_.push_back(
+            chrono::duration<double>(now - client.hint_time).count());
+        client.guesses++;
+        MasterMind::ColorComb intent = game_.string2cc(value);
+        if (intent == client.secret) {
+          request = id + " end";
+        } else {
+          auto bw = game_.Evaluate(client.secret, intent);
+          request = id + " update " + value + " " + to_string(bw.first) +
+              " " + to_string(bw.second);
+        }
+      } else if (kind == "ok") {
+        client.hint_time = chrono::steady_clock::now();
+        request = id + " hint";
+      } else if (kind != "ended") {
+        num_errors_++;
+        request = id + " end";
+      } else {
+        num_guesses_ += client.guesses;
+        clients_.erase(id);
+        finished = ++num_finished_ == num_games_;
+      }
+    }
+    if (!request.empty())
+      server_->Submit(request);
+    else if (finished)
+      done_.notify_all();
+    else
+      Start();
+  }
+
+  void WaitAll() {
+    unique_lock<mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return num_finished_ == num_games_; });
+  }
+
+  vector<double> latencies() const { return latencies_; }
+  uint64_t num_guesses() const { return num_guesses_; }
+  uint64_t num_errors() const { return num_errors_; }
+
+ private:
+  struct Client {
+    MasterMind::ColorComb secret;
+    int guesses = 0;
+    chrono::steady_clock::time_point hint_time;
+  };
+
+  const MasterMind& game_;
+  const size_t num_games_;
+  GameServer* server_ = nullptr;
+
+  mutex mutex_;
+  condition_variable done_;
+  mt19937_64 random_;
+  vector<MasterMind::ColorComb> secrets_;
+  unordered_map<string, Client> clients_;
+  size_t num_started_ = 0, num_finished_ = 0;
+  uint64_t num_guesses_ = 0, num_errors_ = 0;
+  vector<double> latencies_;
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  MasterMind::Strategy strategy = MasterMind::Strategy::kEntropy;
+  size_t num_games = 10000;
+  size_t concurrency = 64;
+  int num_threads = max(1u, thread::hardware_concurrency());
+  bool share = true;
+  double hint_seconds = 0;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    string option = argv[arg];
+    if (option == "--no-share") {
+      share = false;
+    } else if (arg + 1 == argc) {
+      usage();
+    } else if (option == "--strategy") {
+      if (!MasterMind::ParseStrategy(argv[++arg], &strategy))
+        usage();
+    } else if (option == "--games") {
+      num_games = max(1l, atol(argv[++arg]));
+    } else if (option == "--concurrency") {
+      concurrency = max(1l, atol(argv[++arg]));
+    } else if (option == "--threads") {
+      num_threads = max(1, atoi(argv[++arg]));
+    } else if (option == "--hint-ms") {
+      hint_seconds = atof(argv[++arg]) / 1000;
+    } else {
+      usage();
+    }
+  }
+  if (argc - arg != 2 || !MasterMind::Valid(argv[arg], atoi(argv[arg + 1])))
+    usage();
+
+  MasterMind initial(argv[arg], atoi(argv[arg + 1]));
+  initial.set_strategy(strategy);
+  if (share)
+    initial.set_decision_cache(make_shared<DecisionCache>(kDecisionCacheSize));
+  shared_ptr<const GameCache> cache = GameCache::Load(
+      GameCache::Path(initial.colors().size(), initial.num_positions()),
+      initial);
+  initial.set_score_table(
+      cache && cache->score_table() ? cache->score_table() :
+      initial.BuildScoreTable(kScoreTableBudget));
+  // The book has the hints of the entropy strategy
+  shared_ptr<const OpeningBook> book =
+      cache && strategy == MasterMind::Strategy::kEntropy ?
+      cache->book() : nullptr;
+
+  Clients clients(initial, num_games);
+  GameServer server(initial, book, num_threads,
+                    [&](const string& response) {
+                      clients.Respond(response);
+                    }, hint_seconds);
+  clients.set_server(&server);
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < min(concurrency, num_games); i++)
+    clients.Start();
+  clients.WaitAll();
+  double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  server.Wait();
+
+  vector<double> latencies = clients.latencies();
+  sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return 1000 * latencies[min(latencies.size() - 1,
+                                size_t(p * latencies.size()))];
+  };
+  printf("%zu games, %s strategy, %zu in flight, %d threads\n", num_games,
+         MasterMind::StrategyName(strategy), min(concurrency, num_games),
+         num_threads);
+  printf("%zu hints in %.2fs: %.0f hints/s, %.4f guesses per game\n",
+         latencies.size(), seconds, latencies.size() / seconds,
+         double(clients.num_guesses()) / num_games);
+  printf("hint latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+         percentile(0.5), percentile(0.9), percentile(0.99),
+         1000 * latencies.back());
+  if (server.stats().late_hints > 0)
+    printf("%llu hints past the deadline\n",
+           (unsigned long long)server.stats().late_hints);
+  if (clients.num_errors() > 0)
+    printf("%llu errors\n", (unsigned long long)clients.num_errors());
+  if (initial.decision_cache()) {
+    DecisionCache::Stats cache_stats = initial.decision_cache()->stats();
+    printf("decision cache: %zu entries, %llu hits, %llu misses\n",
+           initial.decision_cache()->size(),
+           (unsigned long long)cache_stats.hits,
+           (unsigned long long)cache_stats.misses);
+  }
+  return clients.num_errors() == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "mastermind.h"
+#include "cache.h"
+#include "decision_cache.h"
+#include "opening_book.h"
+#include "server.h"
+#include "solver.h"
+
+// The interactive program uses a score table if it takes at most this
+// many bytes, e.g. up to 8 colors and 4 positions.
+static const size_t kScoreTableBudget = 64 << 20;
+// A cache built offline may contain a larger one, e.g. for 6 colors and
+// 5 positions.
+static const size_t kCacheTableBudget = 256 << 20;
+// The decision cache shared by the games served, see mastermind-sim
+static const size_t kDecisionCacheSize = size_t(1) << 20;
+// Games with more codes, e.g. 10 colors and 8 positions, only generate the
+// possible targets left after the first intent, see MasterMind::Engine.
+static const size_t kMaxEagerCodes = size_t(1) << 24;
+
+static void usage() {
+  printf("Usage: mastermind [--strategy entropy|minimax|most-parts|"
+         "expected-size] [--stats]\n"
+         "                  colors positions\n"
+         "       mastermind [--strategy name] [--hint-ms n] --serve "
+         "colors positions\n"
+         "       mastermind --build-cache colors positions [book_depth]\n"
+         "       mastermind --solve expected|minimax colors positions\n"
+         "with 1 to %d distinct colors and 1 to %d positions\n",
+         MasterMind::kMaxColors, MasterMind::kMaxPositions);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  MasterMind::Strategy strategy = MasterMind::Strategy::kEntropy;
+  bool print_stats = false;
+  bool serve = false;
+  double hint_seconds = 0;
+  while (argc >= 3) {
+    if (string(argv[1]) == "--strategy") {
+      if (!MasterMind::ParseStrategy(argv[2], &strategy))
+        usage();
+      argc -= 2;
+      argv += 2;
+    } else if (string(argv[1]) == "--stats") {
+      print_stats = true;
+      argc--;
+      argv++;
+    } else if (string(argv[1]) == "--hint-ms") {
+      hint_seconds = atof(argv[2]) / 1000;
+      argc -= 2;
+      argv += 2;
+    } else if (string(argv[1]) == "--serve") {
+      serve = true;
+      argc--;
+      argv++;
+    } else {
+      break;
+    }
+  }
+  bool build_cache = (argc == 4 || argc == 5) &&
+      string(argv[1]) == "--build-cache";
+  bool solve = argc == 5 && string(argv[1]) == "--solve" &&
+      (string(argv[2]) == "expected" || string(argv[2]) == "minimax");
+  if (argc != 3 && !build_cache && !solve)
+    usage();
+  int book_depth = argc == 5 ? atoi(argv[4]) : 1;
+  Solver::Objective objective = solve && string(argv[2]) == "minimax" ?
+      Solver::Objective::kMinimax : Solver::Objective::kExpectedGuesses;
+  if (build_cache)
+    argv++;
+  if (solve)
+    argv += 2;
+  if (!MasterMind::Valid(argv[1], atoi(argv[2])))
+    usage();
+
+  size_t num_codes = 1;
+  for (int i = 0; i < atoi(argv[2]); i++)
+    num_codes *= strlen(argv[1]);
+  // Solving and building a cache need all targets up front
+  MasterMind game_assistant(argv[1], atoi(argv[2]),
+                            num_codes > kMaxEagerCodes && !solve &&
+                            !build_cache ?
+                            MasterMind::Engine::kLazy :
+                            MasterMind::Engine::kVectors);
+  if (solve) {
+    Solver solver(game_assistant, objective, kCacheTableBudget);
+    if (!solver.ok()) {
+      fprintf(stderr, "%s with %s positions is too large to solve\n",
+              argv[1], argv[2]);
+      return 1;
+    }
+    int cost = solver.Solve();
+    solver.PrintTree(cout);
+    if (objective == Solver::Objective::kMinimax)
+      printf("At most %d intents\n", cost);
+    else
+      printf("%d intents for %d targets, %.4f on average\n", cost,
+             game_assistant.num_candidates(),
+             double(cost) / game_assistant.num_candidates());
+    return 0;
+  }
+  string cache_path = GameCache::Path(game_assistant.colors().size(),
+                                      game_assistant.num_positions());
+  if (build_cache) {
+    if (!GameCache::Build(game_assistant, cache_path, kCacheTableBudget,
+                          book_depth)) {
+      fprintf(stderr, "Could not write %s\n", cache_path.c_str());
+      return 1;
+    }
+    printf("Wrote %s\n", cache_path.c_str());
+    return 0;
+  }
+
+  // Use the cache if somebody built it
+  shared_ptr<const GameCache> cache =
+      GameCache::Load(cache_path, game_assistant);
+  game_assistant.set_score_table(
+      cache && cache->score_table() ? cache->score_table() :
+      game_assistant.BuildScoreTable(kScoreTableBudget));
+
+  // The book has the hints of the entropy strategy
+  game_assistant.set_strategy(strategy);
+  shared_ptr<const OpeningBook> book =
+      cache && strategy == MasterMind::Strategy::kEntropy ?
+      cache->book() : nullptr;
+  if (serve) {
+    // Requests from stdin, responses to stdout, see GameServer
+    game_assistant.set_decision_cache(
+        make_shared<DecisionCache>(kDecisionCacheSize));
+    GameServer server(game_assistant, book,
+                      max(1u, thread::hardware_concurrency()),
+                      [](const string& response) {
+                        printf("%s\n", response.c_str());
+                        fflush(stdout);
+                      }, hint_seconds);
+    string request;
+    while (getline(cin, request))
+      server.Submit(request);
+    return 0;
+  }
+
+  if (print_stats && !MasterMind::stats_enabled())
+    printf("Compiled without statistics (MASTERMIND_STATS=0)\n");
+  // What MasterMind did this turn
+  auto report = [&]() {
+    if (print_stats)
+      printf("stats: %s\n", game_assistant.stats().Report().c_str());
+    game_assistant.ResetStats();
+  };
+  game_assistant.ResetStats();
+  vector<int> intent_class = book ?
+      book->initial_partition(game_assistant.num_positions()) :
+      game_assistant.ChooseInitialIntent();
+  
+  cout << "You could try any string with the following grouping of colors: ";
+  int last = intent_class.back();
+  intent_class.pop_back();
+  for (auto num: intent_class)
+    cout << num << ",";
+  cout << last << endl;
+  report();
+  
+  vector<MasterMind::ColorComb> intents;
+  vector<pair<int, int>> evaluations;
+  while (true) {
+    cout << "intent black white> ";
+    string intent;
+    int black, white;
+    if (!(cin >> intent >> black >> white))
+      return 0;
+    // Like GameServer, reject what would corrupt the possible targets
+    if (!game_assistant.ValidIntent(intent)) {
+      printf("An intent has %d colors of %s\n",
+             game_assistant.num_positions(),
+             game_assistant.colors().c_str());
+      continue;
+    }
+    if (!game_assistant.ValidEvaluation(black, white)) {
+      printf("Black and white are at least 0 and at most %d together\n",
+             game_assistant.num_positions());
+      continue;
+    }
+    
+    MasterMind::ColorComb cc = game_assistant.string2cc(intent);
+    printf("The entropy (expected information gain) of your intent is %.2f bits\n",
+           game_assistant.Entropy(cc));
+    
+    double information = game_assistant.Update(cc, black, white);
+    if (game_assistant.num_candidates() == 0) {
+      game_assistant.Undo();
+      printf("No target gives that evaluation with the previous ones\n");
+      continue;
+    }
+    intents.push_back(cc);
+    evaluations.emplace_back(black, white);
+    printf("You gained %.2f bits of information\n", information);
+
+    if (game_assistant.num_candidates() == 1) {
+      report();
+      break;
+    }
+    
+    printf("There are %d possible targets left\n", game_assistant.num_candidates());
+    cout << "do you want a hint (y/n) ";
+    char hint;
+    cin >> hint;
+    if (hint == 'y' || hint == 'Y') {
+      MasterMind::ColorComb proposal;
+      if (!book ||
+          !book->Reply(game_assistant, intents, evaluations, &proposal))
+        proposal = game_assistant.ChooseIntent();
+      printf("You could try %s (entropy %.2f bits)\n",
+	     game_assistant.cc2string(proposal).c_str(),
+	     game_assistant.Entropy(proposal));
+    }
+    report();
+  }
+
+  printf("The only possibility is %s\n", game_assistant.cc2string(
+      *game_assistant.target_candidates_begin()).c_str());
+}
@@ -1,31 +1,60 @@
 // -*- eval: (google-set-c-style) -*-
 
 #include <cassert>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
-#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
 #include <set>
+#include <stdexcept>
 #include <vector>
 #include <tuple>
 // #include <array>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
 using namespace std;
 
 #include "mastermind.h"
 
+// MasterMind counts and times what it does (see MasterMind::Stats), which
+// costs little, as only whole calls are counted. Compiling with
+// -DMASTERMIND_STATS=0 removes it altogether.
+#ifndef MASTERMIND_STATS
+#define MASTERMIND_STATS 1
+#endif
+
+#if MASTERMIND_STATS
+#define MASTERMIND_STAT(statement) statement
+#else
+#define MASTERMIND_STAT(statement)
+#endif
+
+// Adds the wall time from its construction to its destruction to *seconds
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(double* seconds)
+      : seconds_(seconds), start_(chrono::steady_clock::now()) {}
+  ~PhaseTimer() {
+    *seconds_ += chrono::duration<double>(
+        chrono::steady_clock::now() - start_).count();
+  }
+
+ private:
+  double* seconds_;
+  chrono::steady_clock::time_point start_;
+};
+
 /*
   Future improvements:
   - allow empty spots in guesses (i.e. a color that is not in the target)
-  - identify equivalent intents
-  - remove intents that will not give extra information
-    for example remove colors that cannot be in the target, leaving one if
-    empty spots are not allowed
   - when the best intents include possible configurations, pick those (the
     reason is that a wrong intent may give you enough information to guess
     the target, you will still have to waste an intent.
-  - The greedy approach implemented here is not necessarily optimal: an
-    option of maximal entropy is chosen, but the outcomes may each have
-    inferior follow up entropies to a non-maximal entropy intent.
  */
 
 // The number of partitions of n in at most k terms of size at most mx
@@ -74,7 +103,7 @@ void MasterMind::ColorClasses(const string& intent,
     counter[color_index_.at(color)]++;
   int i = 0;
   for (auto count: counter) {
-    if (count >= classes->size()) {
+    if (size_t(count) >= classes->size()) {
       classes->resize(count + 1);
     }
     char color = colors_[i];
@@ -99,7 +128,7 @@ const string& MasterMind::ColorClass(char color) const {
 // without changing the order
 string intersect(const string& s1, const string& s2) {
   string ret("");
-  int i1 = 0, i2 = 0;
+  size_t i1 = 0, i2 = 0;
   for (auto c1: s1) {
     for (i2 = i1; i2 < s2.size(); i2++) {
       if (c1 == s2[i2]) {
@@ -135,52 +164,347 @@ void MasterMind::UpdateEquivalences(const string& intent)
   BuildColorClassIndex();
 }
 
-string MasterMind::IntentClass(const string& intent) const {
-  string repr;
-  vector<unordered_map<char, char>> mappings(color_class_list_.size());
-  for (auto color: intent) {
-    int cls = color_class_index_.at(color);
-    if (mappings[cls].count(color) == 0) {
-      int len = mappings[cls].size();
-      // cls[mappings[cls].size()] doesn't work!
-      // LHS creates new entry before RHS is executed!
-      mappings[cls][color] = color_class_list_[cls][len];
+MasterMind::ColorComb MasterMind::IntentClass(ColorComb intent) const {
+  ColorComb repr = 0;
+  // mapping[color] is the color index of the representative, -1 if not
+  // yet assigned
+  int mapping[kMaxColors];
+  fill(mapping, mapping + kMaxColors, -1);
+  vector<int> used(color_class_list_.size(), 0);
+  for (int i = 0; i < num_positions_; i++) {
+    int color = Color(intent, i);
+    if (mapping[color] < 0) {
+      int cls = color_class_index_.at(colors_[color]);
+      mapping[color] = color_index_.at(color_class_list_[cls][used[cls]++]);
     }
-    repr.push_back(mappings[cls][color]);    
+    repr = (repr << 4) | mapping[color];
   }
   
   return repr;
 }
 
-std::string MasterMind::cc2string(const ColorComb& cc) const {
+void MasterMind::PositionClasses(vector<int>* classes) const {
+  classes->resize(num_positions_);
+  for (int i = 0; i < num_positions_; i++) {
+    (*classes)[i] = i;
+    for (int j = 0; j < i; j++) {
+      if (all_of(intents_.begin(), intents_.end(), [&](ColorComb intent) {
+            return Color(intent, i) == Color(intent, j);
+          })) {
+        (*classes)[i] = j;
+        break;
+      }
+    }
+  }
+}
+
+// The maximal number of steps of the search for permutations of used colors
+static const int kMaxSymmetrySearchSteps = 100000;
+
+void MasterMind::SymmetryGenerators(vector<Symmetry>* generators) const {
+  generators->clear();
+  int num_colors = colors_.size();
+  Symmetry identity;
+  for (int i = 0; i < num_positions_; i++)
+    identity.positions[i] = i;
+  for (int c = 0; c < num_colors; c++)
+    identity.colors[c] = c;
+
+  // Transpositions of each position with the next one in its class
+  vector<int> classes;
+  PositionClasses(&classes);
+  for (int i = 0; i < num_positions_; i++) {
+    for (int j = i + 1; j < num_positions_; j++) {
+      if (classes[j] == classes[i]) {
+        generators->push_back(identity);
+        swap(generators->back().positions[i], generators->back().positions[j]);
+        break;
+      }
+    }
+  }
+
+  // Transpositions of consecutive colors that haven't been used
+  vector<bool> used(num_colors, false);
+  for (auto intent: intents_)
+    for (int i = 0; i < num_positions_; i++)
+      used[Color(intent, i)] = true;
+  vector<int> used_colors;
+  int last_unused = -1;
+  for (int c = 0; c < num_colors; c++) {
+    if (used[c]) {
+      used_colors.push_back(c);
+    } else {
+      if (last_unused >= 0) {
+        generators->push_back(identity);
+        swap(generators->back().colors[last_unused],
+             generators->back().colors[c]);
+      }
+      last_unused = c;
+    }
+  }
+  if (used_colors.size() < 2)
+    return;
+
+  // Permutations of the used colors: they have to map the column of colors
+  // of the intents at every position to the column at another position.
+  // The permutation of positions doing so is determined up to the
+  // transpositions above.
+  vector<string> columns(num_positions_);
+  // profiles[c] are the numbers of occurrences of color c in the intents,
+  // which the permutation must preserve
+  vector<string> profiles(num_colors, string(intents_.size(), 0));
+  for (int i = 0; i < num_positions_; i++) {
+    for (size_t j = 0; j < intents_.size(); j++) {
+      columns[i].push_back(Color(intents_[j], i));
+      profiles[Color(intents_[j], i)][j]++;
+    }
+  }
+  vector<string> sorted_columns(columns);
+  sort(sorted_columns.begin(), sorted_columns.end());
+
+  // The subgroup generated by the color permutations found so far, to skip
+  // the ones it contains.
+  vector<int> color_map(identity.colors, identity.colors + num_colors);
+  set<vector<int>> subgroup = {color_map};
+  vector<vector<int>> subgroup_generators;
+  vector<bool> taken(num_colors, false);
+  vector<string> mapped_columns(num_positions_);
+  int steps = 0;
+  auto search = [&](int k, auto& search) {
+    if (steps++ >= kMaxSymmetrySearchSteps)
+      return;
+    if (size_t(k) < used_colors.size()) {
+      int c = used_colors[k];
+      for (auto image: used_colors) {
+        if (!taken[image] && profiles[image] == profiles[c]) {
+          color_map[c] = image;
+          taken[image] = true;
+          search(k + 1, search);
+          taken[image] = false;
+        }
+      }
+      color_map[c] = c;
+      return;
+    }
+    if (subgroup.count(color_map))
+      return;
+    for (int i = 0; i < num_positions_; i++) {
+      mapped_columns[i] = columns[i];
+      for (auto& color: mapped_columns[i])
+        color = color_map[color];
+    }
+    vector<string> sorted_mapped_columns(mapped_columns);
+    sort(sorted_mapped_columns.begin(), sorted_mapped_columns.end());
+    if (sorted_mapped_columns != sorted_columns)
+      return;
+
+    // position i takes the color of a position whose column is mapped to
+    // the column at i
+    Symmetry symmetry = identity;
+    copy(color_map.begin(), color_map.end(), symmetry.colors);
+    vector<bool> matched(num_positions_, false);
+    for (int i = 0; i < num_positions_; i++) {
+      for (int p = 0; p < num_positions_; p++) {
+        if (!matched[p] && mapped_columns[p] == columns[i]) {
+          matched[p] = true;
+          symmetry.positions[i] = p;
+          break;
+        }
+      }
+    }
+    generators->push_back(symmetry);
+
+    // extend the subgroup by composing with all generators until it closes
+    subgroup_generators.push_back(color_map);
+    vector<vector<int>> queue(subgroup.begin(), subgroup.end());
+    while (!queue.empty()) {
+      vector<int> element = queue.back();
+      queue.pop_back();
+      for (auto& generator: subgroup_generators) {
+        vector<int> product(num_colors);
+        for (int c = 0; c < num_colors; c++)
+          product[c] = generator[element[c]];
+        if (subgroup.insert(product).second)
+          queue.push_back(product);
+      }
+    }
+  };
+  search(0, search);
+}
+
+void MasterMind::IntentRepresentatives(vector<int>* representatives) const {
+  representatives->clear();
+  if (lazy_) {
+    GenerateIntentRepresentatives(representatives);
+    return;
+  }
+  vector<Symmetry> generators;
+  if (use_symmetries_)
+    SymmetryGenerators(&generators);
+  if (generators.empty()) {
+    representatives->assign(intent_indices_.begin(),
+                            intent_indices_.begin() + num_intents_);
+    return;
+  }
+  assert(intent_candidates_.size() == num_codes());
+  int n = intent_candidates_.size();
+  vector<bool> pruned(n, true);
+  for (size_t k = 0; k < num_intents_; k++)
+    pruned[intent_indices_[k]] = false;
+  // Visit the orbit of every intent that hasn't been visited yet. If its
+  // smallest intent has been pruned, a smaller one with the same entropy is
+  // the smallest of another orbit or has been pruned in turn, etc.
+  vector<bool> visited(n, false);
+  vector<int> stack;
+  for (int i = 0; i < n; i++) {
+    if (visited[i])
+      continue;
+    if (!pruned[i])
+      representatives->push_back(i);
+    visited[i] = true;
+    stack.push_back(i);
+    while (!stack.empty()) {
+      ColorComb intent = intent_candidates_[stack.back()];
+      stack.pop_back();
+      for (auto& generator: generators) {
+        int j = CodeIndex(Apply(generator, intent));
+        if (!visited[j]) {
+          visited[j] = true;
+          stack.push_back(j);
+        }
+      }
+    }
+  }
+}
+
+void MasterMind::GenerateIntentRepresentatives(
+    vector<int>* representatives) const {
+  assert(num_codes() <= size_t(numeric_limits<int>::max()));
+  if (!use_symmetries_) {
+    representatives->resize(num_codes());
+    iota(representatives->begin(), representatives->end(), 0);
+    return;
+  }
+  // At first, the orbits are those of ChooseInitialIntent
+  if (intents_.empty()) {
+    vector<vector<int>> intent_classes;
+    partitions(num_positions_, colors_.size(), &intent_classes);
+    for (auto& intent_class: intent_classes)
+      representatives->push_back(CodeIndex(InitialIntent(intent_class)));
+    sort(representatives->begin(), representatives->end());
+    return;
+  }
+
+  // Generate the intents in increasing order, position by position, with
+  // the colors that the generators that transpose positions or unused
+  // colors don't map to a smaller intent: at every position the color at
+  // the previous position of its class or a larger one, and the unused
+  // colors in increasing order of their first occurrence. The generators
+  // that permute the used colors are checked once the intent is complete.
+  vector<Symmetry> generators;
+  SymmetryGenerators(&generators);
+  vector<int> classes;
+  PositionClasses(&classes);
+  // the previous position of the class of every position, or -1
+  vector<int> previous(num_positions_, -1);
+  for (int i = 0; i < num_positions_; i++)
+    for (int j = 0; j < i; j++)
+      if (classes[j] == classes[i])
+        previous[i] = j;
+  int num_colors = colors_.size();
+  vector<bool> used(num_colors, false);
+  for (auto intent: intents_)
+    for (int i = 0; i < num_positions_; i++)
+      used[Color(intent, i)] = true;
+  // rank[c] is the number of unused colors less than c, for unused c
+  vector<int> rank(num_colors, 0);
+  for (int c = 1; c < num_colors; c++)
+    rank[c] = rank[c - 1] + !used[c - 1];
+
+  int colors[kMaxPositions];
+  auto generate = [&](int i, ColorComb intent, int num_unused,
+                      auto& generate) {
+    if (i == num_positions_) {
+      for (auto& generator: generators)
+        if (Apply(generator, intent) < intent)
+          return;
+      representatives->push_back(CodeIndex(intent));
+      return;
+    }
+    int first = previous[i] < 0 ? 0 : colors[previous[i]];
+    for (int c = first; c < num_colors; c++) {
+      if (!used[c] && rank[c] > num_unused)
+        continue;
+      colors[i] = c;
+      generate(i + 1, (intent << 4) | c,
+               num_unused + (!used[c] && rank[c] == num_unused), generate);
+    }
+  };
+  generate(0, 0, 0, generate);
+}
+
+std::string MasterMind::cc2string(ColorComb cc) const {
   string ret;
-  for (auto i: cc) {
-    ret.push_back(colors_[i]);
+  for (int i = 0; i < num_positions_; i++) {
+    ret.push_back(colors_[Color(cc, i)]);
   }
   return ret;
 }
 
 MasterMind::ColorComb MasterMind::string2cc(const std::string& s) const {
-  MasterMind::ColorComb ret;
+  MasterMind::ColorComb ret = 0;
   for (auto c: s) {
-    ret.push_back(color_index_.at(c));
+    ret = (ret << 4) | color_index_.at(c);
   }
   return ret;
 }
 
+bool MasterMind::ValidIntent(const string& intent) const {
+  return intent.size() == size_t(num_positions_) &&
+      intent.find_first_not_of(colors_) == string::npos;
+}
 
-void MasterMind::GenerateTargetCandidates(int length, const string& prefix) {
-  if (length < 0)
-    GenerateTargetCandidates(num_positions_, prefix);
-  else if (length == 0)
-    target_candidates_.push_back(prefix);
-  else
-    for (auto it = colors_.begin(); it < colors_.end(); ++it)
-      GenerateTargetCandidates(length - 1, prefix + *it);
+bool MasterMind::ValidEvaluation(int black, int white) const {
+  return black >= 0 && white >= 0 && black + white <= num_positions_;
+}
+
+
+void MasterMind::GenerateTargetCandidates() {
+  size_t total = num_codes();
+  target_candidates_.resize(total);
+  target_counts_.resize(total);
+  GenerateCodes(0, total, target_candidates_.data(), target_counts_.data());
+}
+
+// Enumerates the combinations in increasing order, like an odometer in
+// base colors_.size() whose digits are the nibbles.
+void MasterMind::GenerateCodes(size_t first, size_t n, ColorComb* codes,
+                               ColorCounts* counts) const {
+  const ColorComb last_color = colors_.size() - 1;
+  ColorComb cc = CodeAt(first);
+  ColorCounts cc_counts = CountColors(cc);
+  for (size_t k = 0; k < n; k++) {
+    codes[k] = cc;
+    counts[k] = cc_counts;
+    // increment, carrying over the positions at the last color, and move
+    // the counts of the colors changed along
+    int shift = 0;
+    while (shift < 4 * num_positions_ && ((cc >> shift) & 0xF) == last_color) {
+      cc &= ~(ColorComb(0xF) << shift);
+      cc_counts += 1 - (ColorCounts(1) << (4 * last_color));
+      shift += 4;
+    }
+    if (shift < 4 * num_positions_) {
+      int color = (cc >> shift) & 0xF;
+      cc_counts += (ColorCounts(1) << (4 * (color + 1))) -
+          (ColorCounts(1) << (4 * color));
+    }
+    cc += ColorComb(1) << shift;
+  }
 }
+
   
-int MasterMind::EvaluationNumerical_(
-    const string& target, const string& intent) const {
+int MasterMind::EvaluationNumerical_(ColorComb target, ColorComb intent) const {
   int black, white;
   tie(black, white) = Evaluate(target, intent);
   return EvaluationIndex_(black, white);
@@ -209,7 +533,7 @@ pair<int,int> MasterMind::Evaluate(const string& target, const string& intent) {
   int black = 0, white = 0;
   // present_colors[c] = number of c in intent - number of c in target so far 
   unordered_map<char, int> present_colors;
-  for (int i = 0; i < target.size(); i++) {
+  for (size_t i = 0; i < target.size(); i++) {
     char target_color = target[i];
     char intent_color = intent[i];
     if (target_color == intent_color) {
@@ -226,25 +550,449 @@ pair<int,int> MasterMind::Evaluate(const string& target, const string& intent) {
   return {black, white};
 }
 
+pair<int,int> MasterMind::Evaluate(ColorComb target, ColorComb intent) const {
+  return Evaluate(target, CountColors(target), intent, CountColors(intent));
+}
+
+size_t MasterMind::num_codes() const {
+  size_t total = 1;
+  for (int i = 0; i < num_positions_; i++)
+    total *= colors_.size();
+  return total;
+}
+
+shared_ptr<const ScoreTable> MasterMind::BuildScoreTable(
+    size_t memory_budget) const {
+  size_t n = num_codes();
+  if (n > memory_budget / n)
+    return nullptr;
+  auto results = make_shared<vector<uint8_t>>(n * n);
+  auto table = make_shared<ScoreTable>();
+  table->num_colors = colors_.size();
+  table->num_positions = num_positions_;
+  table->num_codes = n;
+  table->results = results->data();
+  table->storage = results;
+  vector<ColorComb> codes(n);
+  vector<ColorCounts> counts(n);
+  GenerateCodes(0, n, codes.data(), counts.data());
+  for (size_t i = 0; i < n; i++) {
+    uint8_t* row = results->data() + i * n;
+    for (size_t t = 0; t < n; t++) {
+      int common;
+      int black = ScoreKernel(codes[t], counts[t], codes[i], counts[i],
+                              position_bits_, num_positions_, &common);
+      row[t] = result_index_[16 * black + common];
+    }
+  }
+  return table;
+}
+
+shared_ptr<const PartitionMasks> MasterMind::BuildPartitionMasks(
+    size_t memory_budget) const {
+  size_t n = num_codes();
+  size_t num_words = (n + 63) / 64;
+  int num_results = NumResults();
+  if (num_words * num_results > memory_budget / sizeof(uint64_t) / n)
+    return nullptr;
+  auto masks = make_shared<PartitionMasks>();
+  masks->num_codes = n;
+  masks->num_words = num_words;
+  masks->num_results = num_results;
+  masks->masks.resize(n * num_words * num_results);
+  vector<ColorComb> codes(n);
+  vector<ColorCounts> counts(n);
+  GenerateCodes(0, n, codes.data(), counts.data());
+  for (size_t i = 0; i < n; i++) {
+    uint64_t* intent_masks = masks->masks.data() + i * num_words * num_results;
+    for (size_t t = 0; t < n; t++) {
+      int common;
+      int black = ScoreKernel(codes[t], counts[t], codes[i], counts[i],
+                              position_bits_, num_positions_, &common);
+      intent_masks[(t / 64) * num_results + result_index_[16 * black + common]]
+          |= uint64_t(1) << (t % 64);
+    }
+  }
+  return masks;
+}
+
+void MasterMind::BuildLiveTargets() {
+  live_targets_.assign(partition_masks_->num_words, 0);
+  for (size_t i = 0; i < num_targets_; i++)
+    live_targets_[target_indices_[i] / 64] |=
+        uint64_t(1) << (target_indices_[i] % 64);
+  live_words_.clear();
+  for (size_t w = 0; w < live_targets_.size(); w++)
+    if (live_targets_[w] != 0)
+      live_words_.push_back(w);
+}
+
+void MasterMind::set_score_table(shared_ptr<const ScoreTable> score_table) {
+  assert(!score_table ||
+         (size_t(score_table->num_colors) == colors_.size() &&
+          score_table->num_positions == num_positions_));
+  score_table_ = score_table;
+  // the bitset engine needs them as well
+  if (partition_masks_)
+    return;
+  target_indices_.clear();
+  // for all targets, including the eliminated ones that Undo may restore
+  if (score_table_) {
+    target_indices_.reserve(target_candidates_.size());
+    for (auto target: target_candidates_)
+      target_indices_.push_back(CodeIndex(target));
+  }
+}
+
+void MasterMind::CountResults(ColorComb intent, int* counter) const {
+  if (partition_masks_) {
+    count_masks_(live_targets_.data(), live_words_.data(), live_words_.size(),
+                 partition_masks_->intent_masks(CodeIndex(intent)),
+                 partition_masks_->num_results, counter);
+    return;
+  }
+  if (implicit_targets()) {
+    if (score_table_) {
+      const uint8_t* row = score_table_->row(CodeIndex(intent));
+      for (size_t t = 0; t < num_targets_; t++)
+        counter[row[t]]++;
+      return;
+    }
+    ColorCounts intent_counts = CountColors(intent);
+    ForEachCodeBlock(1, [&](int, size_t, const ColorComb* codes,
+                            const ColorCounts* counts, size_t n) {
+        score_batch_(codes, counts, n, intent, intent_counts,
+                     num_positions_, result_index_, counter);
+      });
+    return;
+  }
+  if (score_table_) {
+    const uint8_t* row = score_table_->row(CodeIndex(intent));
+    for (size_t i = 0; i < num_targets_; i++)
+      counter[row[target_indices_[i]]]++;
+    return;
+  }
+  score_batch_(target_candidates_.data(), target_counts_.data(),
+               num_targets_, intent, CountColors(intent),
+               num_positions_, result_index_, counter);
+}
+
 // The events are the evaluations, 14 of them for four positions.
 // For a given intent, the space of targets is partitioned by the outcomes.
 // The entropy of that partition (event space) is returned, where all
 // targets are assumed to be equally likely.
-double MasterMind::Entropy(const string& intent) const {
+double MasterMind::Entropy(ColorComb intent) const {
   vector<int> counter(NumResults(), 0);
-  for (auto target: target_candidates_)
-    counter[EvaluationNumerical_(target, intent)]++;
-  double S = 0;
-  double N = target_candidates_.size();
+  CountResults(intent, counter.data());
+  return EntropyOfCounts(counter.data());
+}
+
+// The entropy of results of sizes c, of N targets in all, is
+//   sum -c/N log2(c/N) = log2 N - S / N,  with S = sum c log2 c,
+// so for the N targets of a turn, the intents of maximal entropy are those
+// of minimal S. S is summed in fixed point, with the values of c log2 c of
+// the smaller sizes looked up in a table: the sum doesn't depend on the
+// order of the sizes, so intents whose results have the same sizes get
+// exactly the same entropy, whatever the engine or the number of threads,
+// and the ties between them are broken by PickIntent rather than by
+// rounding errors. The values have this many fraction bits, or fewer for
+// more targets than kMaxPreciseTargets, so that S stays below 2^63.
+static const int kFractionBits = 32;
+static const int kCoarseFractionBits = 24;
+static const size_t kMaxPreciseTargets = size_t(1) << 26;
+static const int kWeightedLogTableSize = 1 << 16;
+
+static int FractionBits(size_t num_targets) {
+  return num_targets < kMaxPreciseTargets ? kFractionBits :
+      kCoarseFractionBits;
+}
+
+// The value of one unit in the last fraction bit
+static double FractionUnit(int fraction_bits) {
+  return 1.0 / double(int64_t(1) << fraction_bits);
+}
+
+// c log2 c in fixed point with the given fraction bits
+static int64_t WeightedLog(int c, int fraction_bits) {
+  static const vector<int64_t> table = []() {
+    vector<int64_t> table(kWeightedLogTableSize, 0);
+    for (int c = 2; c < kWeightedLogTableSize; c++)
+      table[c] = llround(ldexp(c * log2(double(c)), kFractionBits));
+    return table;
+  }();
+  if (c < kWeightedLogTableSize && fraction_bits == kFractionBits)
+    return table[c];
+  return c < 2 ? 0 : llround(ldexp(c * log2(double(c)), fraction_bits));
+}
+
+double MasterMind::EntropyOfCounts(const int* counter) const {
   // The information content of an event A with probability p = p(A) is
   // i(A) = log2(1/p) = -log2(p)
   // The expected information content is called the entropy.
-  auto weighted_information_content = [](double p) { return -p * log2(p); };
-  for (auto count: counter) {
-    double p = count / N;
-    S += p != 0 ? weighted_information_content(p) : 0;
+  int fraction_bits = FractionBits(num_targets_);
+  int64_t S = 0;
+  for (int i = 0; i < NumResults(); i++)
+    S += WeightedLog(counter[i], fraction_bits);
+  double N = num_targets_;
+  return log2(N) - double(S) * FractionUnit(fraction_bits) / N;
+}
+
+MasterMind::IntentScores MasterMind::ScoresOfCounts(const int* counter) const {
+  IntentScores scores{EntropyOfCounts(counter), 0, 0, 0};
+  double sum_squares = 0;
+  for (int i = 0; i < NumResults(); i++) {
+    if (counter[i] > 0) {
+      scores.num_parts++;
+      scores.largest_part = max(scores.largest_part, counter[i]);
+      sum_squares += double(counter[i]) * counter[i];
+    }
+  }
+  // a target is in a part of size c with probability c / N
+  scores.expected_size = sum_squares / num_targets_;
+  return scores;
+}
+
+MasterMind::IntentScores MasterMind::Scores(ColorComb intent) const {
+  vector<int> counter(NumResults(), 0);
+  CountResults(intent, counter.data());
+  return ScoresOfCounts(counter.data());
+}
+
+double MasterMind::IntentScores::Get(Strategy strategy) const {
+  switch (strategy) {
+    case Strategy::kEntropy:
+      return entropy;
+    case Strategy::kMinimax:
+      return -largest_part;
+    case Strategy::kMostParts:
+      return num_parts;
+    case Strategy::kExpectedSize:
+      return -expected_size;
+  }
+  return 0;
+}
+
+const char* MasterMind::StrategyName(Strategy strategy) {
+  switch (strategy) {
+    case Strategy::kEntropy:
+      return "entropy";
+    case Strategy::kMinimax:
+      return "minimax";
+    case Strategy::kMostParts:
+      return "most-parts";
+    case Strategy::kExpectedSize:
+      return "expected-size";
+  }
+  return "unknown";
+}
+
+void MasterMind::Stats::Add(const Stats& other) {
+  updates += other.updates;
+  targets_before += other.targets_before;
+  targets_after += other.targets_after;
+  targets_scored += other.targets_scored;
+  intents_pruned += other.intents_pruned;
+  update_seconds += other.update_seconds;
+  prune_seconds += other.prune_seconds;
+  choices += other.choices;
+  decision_cache_hits += other.decision_cache_hits;
+  intents_rated += other.intents_rated;
+  scorings += other.scorings;
+  scorings_saved += other.scorings_saved;
+  evaluations += other.evaluations;
+  symmetry_seconds += other.symmetry_seconds;
+  bound_seconds += other.bound_seconds;
+  search_seconds += other.search_seconds;
+}
+
+string MasterMind::Stats::Report() const {
+  string report;
+  auto add = [&](const char* format, double value) {
+    if (value == 0)
+      return;
+    char item[64];
+    snprintf(item, sizeof(item), format, value);
+    report += (report.empty() ? "" : ", ") + string(item);
+  };
+  add("%.0f updates", updates);
+  add("%.0f targets before", targets_before);
+  add("%.0f after", targets_after);
+  add("%.0f scored", targets_scored);
+  add("%.0f intents pruned", intents_pruned);
+  add("update %.3f ms", 1000 * update_seconds);
+  add("pruning %.3f ms", 1000 * prune_seconds);
+  add("%.0f choices", choices);
+  add("%.0f from the decision cache", decision_cache_hits);
+  add("%.0f intents rated", intents_rated);
+  add("%.0f scorings", scorings);
+  add("%.0f saved", scorings_saved);
+  add("%.0f evaluations", evaluations);
+  add("symmetries %.3f ms", 1000 * symmetry_seconds);
+  add("bounds %.3f ms", 1000 * bound_seconds);
+  add("search %.3f ms", 1000 * search_seconds);
+  return report.empty() ? "nothing" : report;
+}
+
+bool MasterMind::stats_enabled() {
+  return MASTERMIND_STATS;
+}
+
+bool MasterMind::Valid(const string& colors, int num_positions) {
+  if (colors.empty() || colors.size() > kMaxColors ||
+      num_positions < 1 || num_positions > kMaxPositions)
+    return false;
+  string sorted(colors);
+  sort(sorted.begin(), sorted.end());
+  return adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+}
+
+const string& MasterMind::ValidColors(const string& colors,
+                                      int num_positions) {
+  if (!Valid(colors, num_positions))
+    throw invalid_argument("no game of " + to_string(num_positions) +
+                           " positions with the colors " + colors);
+  return colors;
+}
+
+bool MasterMind::ParseStrategy(const string& name, Strategy* strategy) {
+  for (int k = 0; k < kNumStrategies; k++) {
+    if (name == StrategyName(Strategy(k))) {
+      *strategy = Strategy(k);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MasterMind::GetBoundData(BoundData* data) const {
+  vector<ColorCounts> counts(target_counts_.begin(),
+                             target_counts_.begin() + num_targets_);
+  sort(counts.begin(), counts.end());
+  data->color_counts.clear();
+  for (size_t i = 0; i < counts.size(); i++) {
+    if (i == 0 || counts[i] != counts[i - 1])
+      data->color_counts.emplace_back(counts[i], 0);
+    data->color_counts.back().second++;
+  }
+  data->results.assign(num_positions_ + 1, vector<int>());
+  for (int black = 0; black <= num_positions_; black++) {
+    for (int white = 0; black + white <= num_positions_; white++) {
+      if (black != num_positions_ - 1 || white != 1)
+        data->results[black + white].push_back(EvaluationIndex_(black, white));
+    }
+  }
+}
+
+void MasterMind::CountCommon(ColorComb intent, const BoundData& data,
+                             int* num_common) const {
+  ColorCounts intent_counts = CountColors(intent);
+  fill(num_common, num_common + num_positions_ + 1, 0);
+  // only the common colors of ScoreKernel are used
+  for (auto& color_counts: data.color_counts) {
+    int common;
+    ScoreKernel(intent, color_counts.first, intent, intent_counts,
+                position_bits_, num_positions_, &common);
+    num_common[common] += color_counts.second;
   }
-  return S;
+}
+
+double MasterMind::EntropyUpperBound(const BoundData& data,
+                                     const int* num_common,
+                                     const int* counter) const {
+  // S as in EntropyOfCounts, with the raised counts added separately
+  int fraction_bits = FractionBits(num_targets_);
+  int64_t S = 0;
+  double raised = 0;
+  for (int common = 0; common <= num_positions_; common++) {
+    if (num_common[common] == 0)
+      continue;
+    const vector<int>& results = data.results[common];
+    int num_results = results.size();
+    double counts[kMaxPositions + 1];
+    double remaining = num_common[common];
+    for (int i = 0; i < num_results; i++) {
+      counts[i] = counter[results[i]];
+      remaining -= counts[i];
+    }
+    sort(counts, counts + num_results);
+    // Raise the smallest j counts to the level that uses up the remaining
+    // targets, for the first j such that it doesn't exceed the next count.
+    double sum = 0, level = 0;
+    int j = 0;
+    while (j < num_results) {
+      sum += counts[j++];
+      level = (sum + remaining) / j;
+      if (j == num_results || level <= counts[j])
+        break;
+    }
+    raised += level > 0 ? j * level * log2(level) : 0;
+    for (int i = j; i < num_results; i++)
+      S += WeightedLog(int(counts[i]), fraction_bits);
+  }
+  double N = num_targets_;
+  return log2(N) - (double(S) * FractionUnit(fraction_bits) + raised) / N;
+}
+
+// The targets are scored in this many blocks (of at least kMinBlockSize
+// targets), checking the upper bound after each: computing it costs about as
+// much as scoring a few hundred targets.
+static const size_t kNumBoundBlocks = 8;
+static const size_t kMinBlockSize = 256;
+// Intents are only abandoned if their upper bound is less than the
+// threshold by more than this, so that rounding errors in the bound can't
+// make intents of equal entropy be abandoned.
+static const double kEntropyEpsilon = 1e-9;
+
+double MasterMind::BoundedEntropy(ColorComb intent, double threshold,
+                                  const BoundData& data, const int* num_common,
+                                  size_t* num_scored) const {
+  ColorCounts intent_counts = CountColors(intent);
+  vector<int> counter(NumResults(), 0);
+  size_t scored = 0;
+  auto abandon = [&]() {
+    return EntropyUpperBound(data, num_common, counter.data()) <
+        threshold - kEntropyEpsilon;
+  };
+  if (!abandon()) {
+    if (partition_masks_) {
+      const uint64_t* masks =
+          partition_masks_->intent_masks(CodeIndex(intent));
+      size_t block_size = max(kMinBlockSize / 64,
+                              live_words_.size() / kNumBoundBlocks + 1);
+      for (size_t w = 0; w < live_words_.size(); w += block_size) {
+        count_masks_(live_targets_.data(), live_words_.data() + w,
+                     min(block_size, live_words_.size() - w), masks,
+                     partition_masks_->num_results, counter.data());
+        scored = accumulate(counter.begin(), counter.end(), size_t(0));
+        if (scored < num_targets_ && abandon())
+          break;
+      }
+    } else {
+      const uint8_t* row =
+          score_table_ ? score_table_->row(CodeIndex(intent)) : nullptr;
+      size_t block_size =
+          max(kMinBlockSize, num_targets_ / kNumBoundBlocks + 1);
+      for (size_t begin = 0; begin < num_targets_; begin += block_size) {
+        size_t end = min(num_targets_, begin + block_size);
+        if (row) {
+          for (size_t i = begin; i < end; i++)
+            counter[row[target_indices_[i]]]++;
+        } else {
+          score_batch_(target_candidates_.data() + begin,
+                       target_counts_.data() + begin, end - begin, intent,
+                       intent_counts, num_positions_, result_index_,
+                       counter.data());
+        }
+        scored = end;
+        if (scored < num_targets_ && abandon())
+          break;
+      }
+    }
+  }
+  *num_scored = scored;
+  return scored < num_targets_ ?
+      EntropyUpperBound(data, num_common, counter.data()) :
+      EntropyOfCounts(counter.data());
 }
 
 // If the candidate of the given index, with the specified entropy,
@@ -264,371 +1012,883 @@ static double updateOptimalIntents(
   return max_entropy;
 }
   
+// Computes entropy(i, &state) for i = 0,..,n-1 on num_threads threads, each
+// with its own State (e.g. a cache), and returns the indices of maximal
+// entropy in increasing order. Threads take chunks of consecutive indices,
+// keep their own optimal intents through updateOptimalIntents, and these
+// are merged afterwards, so that the result is the same as that of a serial
+// loop, whatever the number of threads.
+template <typename State, typename EntropyFunction>
+static vector<int> findOptimalIntents(int n, int num_threads,
+                                      EntropyFunction entropy) {
+  const int kChunkSize = 64;
+  num_threads = max(1, min(num_threads, (n + kChunkSize - 1) / kChunkSize));
+  atomic<int> next_chunk(0);
+  vector<double> max_entropies(num_threads,
+                               -numeric_limits<double>::infinity());
+  vector<vector<int>> optimal_intents(num_threads);
+  auto work = [&](int thread_index) {
+    State state;
+    int begin;
+    while ((begin = next_chunk.fetch_add(kChunkSize)) < n) {
+      for (int i = begin; i < min(n, begin + kChunkSize); ++i) {
+        max_entropies[thread_index] = updateOptimalIntents(
+            i, entropy(i, &state), max_entropies[thread_index],
+            &optimal_intents[thread_index]);
+      }
+    }
+  };
+  vector<thread> threads;
+  for (int t = 1; t < num_threads; t++)
+    threads.emplace_back(work, t);
+  work(0);
+  for (auto& t: threads)
+    t.join();
+
+  double max_entropy = *max_element(max_entropies.begin(), max_entropies.end());
+  vector<int> result;
+  for (int t = 0; t < num_threads; t++) {
+    if (max_entropies[t] == max_entropy)
+      result.insert(result.end(), optimal_intents[t].begin(),
+                    optimal_intents[t].end());
+  }
+  sort(result.begin(), result.end());
+  return result;
+}
+
+struct NoState {};
+
+// Calls f(i) for i = 0,..,n-1 on num_threads threads, which take chunks of
+// consecutive indices like in findOptimalIntents.
+template <typename Function>
+static void forEachIndex(int n, int num_threads, Function f) {
+  findOptimalIntents<NoState>(n, num_threads, [&](int i, NoState*) {
+      f(i);
+      return 0.0;
+    });
+}
+
+// The lazy engine generates the codes in blocks of this size, which fit in
+// the L2 cache.
+static const size_t kCodeBlockSize = 4096;
+
+template <typename Function>
+void MasterMind::ForEachCodeBlock(int num_threads, Function f) const {
+  size_t total = num_codes();
+  size_t num_blocks = (total + kCodeBlockSize - 1) / kCodeBlockSize;
+  forEachIndex(num_blocks, num_threads, [&](int b) {
+      ColorComb codes[kCodeBlockSize];
+      ColorCounts counts[kCodeBlockSize];
+      size_t first = b * kCodeBlockSize;
+      size_t n = min(kCodeBlockSize, total - first);
+      GenerateCodes(first, n, codes, counts);
+      f(b, first, codes, counts, n);
+    });
+}
+
+void MasterMind::ScoreIntents(const vector<ColorComb>& intents,
+                              vector<IntentScores>* scores) const {
+  int n = intents.size();
+  scores->resize(n);
+  if (!implicit_targets() || score_table_) {
+    forEachIndex(n, num_threads_,
+                 [&](int i) { (*scores)[i] = Scores(intents[i]); });
+    return;
+  }
+  // Generate every block of codes once, for all intents
+  int num_results = NumResults();
+  vector<ColorCounts> intent_counts;
+  for (auto intent: intents)
+    intent_counts.push_back(CountColors(intent));
+  vector<int> counters(size_t(n) * num_results, 0);
+  mutex counters_mutex;
+  ForEachCodeBlock(num_threads_, [&](int, size_t, const ColorComb* codes,
+                                     const ColorCounts* counts, size_t m) {
+      vector<int> block_counters(counters.size(), 0);
+      for (int i = 0; i < n; i++)
+        score_batch_(codes, counts, m, intents[i], intent_counts[i],
+                     num_positions_, result_index_,
+                     &block_counters[size_t(i) * num_results]);
+      lock_guard<mutex> lock(counters_mutex);
+      for (size_t k = 0; k < counters.size(); k++)
+        counters[k] += block_counters[k];
+    });
+  for (int i = 0; i < n; i++)
+    (*scores)[i] = ScoresOfCounts(&counters[size_t(i) * num_results]);
+}
+
 // For n colors, equivalence classes of starting positions correspond to
 // partitions of the number of positions in at most n summands.
 // The best partition is returned.
 vector<int> MasterMind::ChooseInitialIntent() const {
   vector<vector<int>> intent_classes;
   partitions(num_positions_, colors_.size(), &intent_classes);
-  vector<int> optimal_intents;
-  double max_entropy = -1;
-  for (int i = 0; i < intent_classes.size(); ++i) {
-    // create intent from partition
-    string intent;
-    vector<int>& intent_class = intent_classes[i];
-    int j = 0;
-    for (auto num: intent_class) {        
-      intent += string(num, colors_[j]);
-      j++;
-    }
-
-    max_entropy = updateOptimalIntents(
-        i, Entropy(intent), max_entropy, &optimal_intents);
+  vector<ColorComb> intents;
+  for (auto& intent_class: intent_classes)
+    intents.push_back(InitialIntent(intent_class));
+
+  MASTERMIND_STAT(stats_.choices++);
+  MASTERMIND_STAT(stats_.intents_rated += intents.size());
+  MASTERMIND_STAT(stats_.scorings += intents.size() * num_targets_);
+  MASTERMIND_STAT(stats_.evaluations += intents.size() * num_targets_);
+  MASTERMIND_STAT(PhaseTimer timer(&stats_.search_seconds));
+  vector<IntentScores> scores;
+  ScoreIntents(intents, &scores);
+  vector<int> optimal_intents = findOptimalIntents<NoState>(
+      intents.size(), 1,
+      [&](int i, NoState*) { return scores[i].Get(strategy_); });
+  return intent_classes[optimal_intents.front()];
+}
 
-    /*
-    double entropy = Entropy(intent);
-    // cout << intent << ": " << entropy << endl;
-    if (entropy >= max_entropy) {
-      if (entropy > max_entropy) {
-        optimal_intents.clear();
-        max_entropy = entropy;  
-      }
-      optimal_intents.push_back(i);
-    }
-    */
+MasterMind::ColorComb MasterMind::InitialIntent(
+    const vector<int>& partition) const {
+  ColorComb intent = 0;
+  int j = 0;
+  for (auto num: partition) {        
+    for (int k = 0; k < num; k++)
+      intent = (intent << 4) | j;
+    j++;
   }
-  
-  return intent_classes[optimal_intents.front()];    
+  return intent;
 }
 
-string MasterMind::PickIntent(const vector<int>& optimal_intents) const {
+bool MasterMind::IsPossibleTarget(ColorComb cc) const {
+  return implicit_targets() ||
+      binary_search(target_candidates_begin(), target_candidates_end(), cc);
+}
+
+MasterMind::ColorComb MasterMind::PickIntent(
+    const vector<int>& optimal_intents) const {
   for (auto i: optimal_intents) { 
-    auto it = find(target_candidates_.begin(), target_candidates_.end(),
-                   intent_candidates_[i]);
-    if (it != target_candidates_.end())
-      return intent_candidates_[i];
+    if (IsPossibleTarget(IntentAt(i)))
+      return IntentAt(i);
   }
-  return intent_candidates_[optimal_intents.front()];
+  return IntentAt(optimal_intents.front());
 }
 
-
-// Refactor this for repeated code.
-string MasterMind::Choose2ndIntent() const {
-  assert(!intent_candidates_.empty());
-  unordered_map<string, double> cached_intents;
-  vector<int> optimal_intents;
-  double max_entropy = -1;
-  for (int i = 0; i < intent_candidates_.size(); ++i) {
-    string intent_class = IntentClass(intent_candidates_[i]);
-    if (cached_intents.count(intent_class) == 0)
-      cached_intents[intent_class] = Entropy(intent_class);
-
-    max_entropy = updateOptimalIntents(
-        i, cached_intents[intent_class], max_entropy, &optimal_intents);
-
-    /*    
-    double entropy = cached_intents[intent_class];
-    if (entropy >= max_entropy) {
-      if (entropy > max_entropy) {
-        optimal_intents.clear();
-        max_entropy = entropy;  
-      }
-      optimal_intents.push_back(i);
-    }
-    */
+DecisionCache::Key MasterMind::DecisionKey() const {
+  // Two independent hashes, of the game and strategy and then every target
+  uint64_t h0 = 0x243F6A8885A308D3 ^ (uint64_t(colors_.size()) << 32) ^
+      (uint64_t(num_positions_) << 16) ^ uint64_t(strategy_);
+  uint64_t h1 = 0x13198A2E03707344 + num_targets_ + (h0 << 1);
+  auto add = [&](ColorComb target) {
+    h0 = (h0 ^ target) * 0x9E3779B97F4A7C15;
+    h0 ^= h0 >> 29;
+    h1 = (h1 + target) * 0xC2B2AE3D27D4EB4F;
+    h1 ^= h1 >> 31;
+  };
+  // the same key as the other engines
+  if (implicit_targets()) {
+    ForEachCodeBlock(1, [&](int, size_t, const ColorComb* codes,
+                            const ColorCounts*, size_t n) {
+        for (size_t i = 0; i < n; i++)
+          add(codes[i]);
+      });
+  } else {
+    for (size_t i = 0; i < num_targets_; i++)
+      add(target_candidates_[i]);
   }
+  return DecisionCache::Key{{h0, h1}};
+}
 
-  return PickIntent(optimal_intents);
+MasterMind::ColorComb MasterMind::ChooseIntent(SearchStats* stats) const {
+  return ChooseIntent(SearchLimits(), stats);
 }
 
-string MasterMind::ChooseIntent() const {
-  assert(!intent_candidates_.empty());
-  vector<int> optimal_intents;
-  double max_entropy = -1;
-  for (int i = 0; i < intent_candidates_.size(); ++i) {
-    string intent = intent_candidates_[i];
-
-    max_entropy = updateOptimalIntents(
-        i, Entropy(intent), max_entropy, &optimal_intents);
-
-    /*    
-    double entropy = Entropy(intent);
-    if (entropy >= max_entropy) {
-      if (entropy > max_entropy) {
-        optimal_intents.clear();
-        max_entropy = entropy;  
+MasterMind::ColorComb MasterMind::ChooseIntent(const SearchLimits& limits,
+                                               SearchStats* stats) const {
+  MASTERMIND_STAT(stats_.choices++);
+  if (stats)
+    *stats = SearchStats();
+  // Inconsistent evaluations leave no intent to prefer
+  if (num_targets_ == 0)
+    return 0;
+  // The intent only depends on the possible targets and the strategy
+  DecisionCache::Key key;
+  if (decision_cache_) {
+    key = DecisionKey();
+    ColorComb intent;
+    if (decision_cache_->Find(key, &intent)) {
+      MASTERMIND_STAT(stats_.decision_cache_hits++);
+      if (stats) {
+        *stats = SearchStats();
+        stats->cached = true;
       }
-      optimal_intents.push_back(i);
+      return intent;
     }
-    */
   }
-  return PickIntent(optimal_intents);
-}
-
-double MasterMind::Update(const string& intent, int black, int white) {
-  int result = EvaluationIndex_(black, white);
-  decltype(target_candidates_) new_candidates;
-  remove_copy_if(target_candidates_.begin(), target_candidates_.end(),
-                 inserter(new_candidates, new_candidates.end()),
-                 [&intent, result, this](const string& target)
-                 { return EvaluationNumerical_(target, intent) != result; });
-  swap(target_candidates_, new_candidates);
-  UpdateEquivalences(intent);
-  return log2(static_cast<double>(new_candidates.size()) / target_candidates_.size());
+  SearchStats search_stats;
+  ColorComb intent = ComputeIntent(limits, &search_stats);
+  if (stats)
+    *stats = search_stats;
+  if (decision_cache_ && search_stats.complete())
+    decision_cache_->Insert(key, intent);
+  return intent;
 }
 
-// int main_play(int argc, char *argv[]) {
-int main(int argc, char *argv[]) {
-  if (argc != 3) {
-    std::printf("Usage: mastermind colors positions\n");
-    exit(0);
+// With limits, the lazy engine scores this many of the first intents at a
+// time, generating the codes once for each batch.
+static const size_t kImplicitBatchSize = 8;
+
+MasterMind::ColorComb MasterMind::ComputeIntent(const SearchLimits& limits,
+                                                SearchStats* stats) const {
+  assert(lazy_ || !intent_candidates_.empty());
+  bool limited = limits.stop ||
+      limits.deadline != chrono::steady_clock::time_point::max();
+  auto expired = [&]() {
+    return (limits.stop && limits.stop->load(memory_order_relaxed)) ||
+        chrono::steady_clock::now() >= limits.deadline;
+  };
+
+  // The smallest optimal intent that is a possible target (or else the
+  // smallest optimal one) is the smallest of its orbit, as the intents of an
+  // orbit have the same entropy and are all possible targets or none.
+  vector<int> representatives;
+  {
+    MASTERMIND_STAT(PhaseTimer timer(&stats_.symmetry_seconds));
+    IntentRepresentatives(&representatives);
   }
-
-  MasterMind game_assistant(argv[1], atoi(argv[2]));
-
-  vector<int> intent_class = game_assistant.ChooseInitialIntent();
-  
-  cout << "You could try any string with the following grouping of colors: ";
-  int last = intent_class.back();
-  intent_class.pop_back();
-  for (auto num: intent_class)
-    cout << num << ",";
-  cout << last << endl;
-  
-  while (true) {
-    cout << "intent black white> ";
-    string intent;
-    int black, white;
-    cin >> intent >> black >> white;
-    
-    printf("The entropy (expected information gain) of your intent is %.2f bits\n",
-           game_assistant.Entropy(intent));
-    
-    double information = game_assistant.Update(intent, black, white);
-    printf("You gained %.2f bits of information\n", information);
-
-    if (game_assistant.num_candidates() == 1)
-      break;
-    
-    printf("There are %d possible targets left\n", game_assistant.num_candidates());
-    cout << "do you want a hint (y/n) ";
-    char hint;
-    cin >> hint;
-    if (hint == 'y' || hint == 'Y') {
-      string proposal = game_assistant.exist_equivalences() ?
-	game_assistant.Choose2ndIntent() :
-	game_assistant.ChooseIntent();
-      printf("You could try %s (entropy %.2f bits)\n",
-	     proposal.c_str(), game_assistant.Entropy(proposal));
+  // Within limits, the time is better spent rating intents
+  if (!limited)
+    DeduplicateIntents(&representatives);
+  int n = representatives.size();
+
+  // Bounded search evaluates the representatives in decreasing order of
+  // the bound given by their numbers of common colors, so that once the best
+  // entropy found exceeds it, the ones that follow are skipped right away.
+  // The bounds are bounds of the entropy, and need the color counts of the
+  // targets, which the lazy engine doesn't store at first.
+  // Computing all bounds costs more than the rest of most searches, so with
+  // limits, the bound of an intent is only computed when it is reached, and
+  // the intents are rated in their canonical order instead.
+  bool bounded_search = bounded_search_ && strategy_ == Strategy::kEntropy &&
+      !implicit_targets();
+  BoundData bound_data;
+  int stride = num_positions_ + 1;
+  vector<int> num_common;
+  vector<double> bounds;
+  vector<int> no_results(NumResults(), 0);
+  auto compute_bound = [&](int i) {
+    CountCommon(IntentAt(representatives[i]), bound_data,
+                &num_common[i * stride]);
+    bounds[i] = EntropyUpperBound(bound_data, &num_common[i * stride],
+                                  no_results.data());
+  };
+  atomic<uint64_t> scorings(0), scorings_saved(0), evaluations(0);
+  if (bounded_search) {
+    MASTERMIND_STAT(PhaseTimer timer(&stats_.bound_seconds));
+    GetBoundData(&bound_data);
+    num_common.resize(n * stride);
+    bounds.resize(n);
+    if (!limited) {
+      forEachIndex(n, num_threads_, compute_bound);
+      scorings = uint64_t(n) * bound_data.color_counts.size();
     }
   }
-
-  printf("The only possibility is %s\n", game_assistant.target_candidates_begin()->c_str());
-}
-
-/////////////////////////////  TESTS  /////////////////////////////////////
-
-int main_test_constructor(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors npos\n");
-    exit(0);
+  // The possible targets first, for when the search is stopped early
+  vector<uint8_t> possible(n);
+  for (int i = 0; i < n; i++)
+    possible[i] = IsPossibleTarget(IntentAt(representatives[i]));
+  vector<int> order(n);
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&](int i1, int i2) {
+      if (possible[i1] != possible[i2])
+        return possible[i1] > possible[i2];
+      return bounded_search && !limited && bounds[i1] > bounds[i2];
+    });
+
+  // The lazy engine scores the first intents all at once, or with limits
+  // in batches, in this order
+  vector<IntentScores> implicit_scores;
+  if (implicit_targets()) {
+    size_t batch_size = limited ? kImplicitBatchSize : n;
+    for (int i = 0; i < n && (i == 0 || !expired()); i += batch_size) {
+      vector<ColorComb> intents;
+      for (int j = i; j < min<int>(n, i + batch_size); j++)
+        intents.push_back(IntentAt(representatives[order[j]]));
+      vector<IntentScores> scores;
+      ScoreIntents(intents, &scores);
+      implicit_scores.insert(implicit_scores.end(), scores.begin(),
+                             scores.end());
+    }
   }
 
-  MasterMind colors(argv[1], atoi(argv[2]));
-
-  // printf("try %s\n", g_colors.substr(0,4).c_str());
-  // char result[5];
-  // scanf("%4s", result);
-  // printf("%s\n", result);
-  string result;
-  getline(cin, result);
-  printf("%s\n", result.c_str());
-  return 0;
-}
-
-int main_test_evaluation(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc > 1) {
-    std::printf("Usage: mastermind\n");
-    exit(0);
+  // the best entropy found so far by any thread
+  atomic<double> max_entropy(-1);
+  // the intents that were rated, and those that were rated or skipped
+  atomic<int> num_rated(0), num_covered(0);
+  MASTERMIND_STAT(PhaseTimer search_timer(&stats_.search_seconds));
+  vector<int> optimal_intents = findOptimalIntents<NoState>(
+      n, num_threads_,
+      [&](int i, NoState*) {
+        // Past the limits, the intents left aren't rated, but some intent
+        // is
+        if (implicit_targets() ? size_t(i) >= implicit_scores.size() :
+            limited && num_covered > 0 && expired())
+          return -numeric_limits<double>::infinity();
+        num_covered++;
+        int k = order[i];
+        ColorComb intent = IntentAt(representatives[k]);
+        if (!bounded_search) {
+          num_rated++;
+          scorings += num_targets_;
+          evaluations += num_targets_;
+          if (!implicit_scores.empty())
+            return implicit_scores[i].Get(strategy_);
+          return strategy_ == Strategy::kEntropy ? Entropy(intent) :
+              Scores(intent).Get(strategy_);
+        }
+        if (limited) {
+          compute_bound(k);
+          scorings += bound_data.color_counts.size();
+        }
+        if (bounds[k] < max_entropy - kEntropyEpsilon) {
+          scorings_saved += num_targets_;
+          return bounds[k];
+        }
+        num_rated++;
+        size_t num_scored;
+        double entropy = BoundedEntropy(intent, max_entropy, bound_data,
+                                        &num_common[k * stride], &num_scored);
+        scorings += num_scored;
+        evaluations += num_scored;
+        scorings_saved += num_targets_ - num_scored;
+        double max = max_entropy;
+        while (entropy > max &&
+               !max_entropy.compare_exchange_weak(max, entropy)) {}
+        return entropy;
+      });
+  for (auto& i: optimal_intents)
+    i = representatives[order[i]];
+  sort(optimal_intents.begin(), optimal_intents.end());
+  if (stats) {
+    stats->scorings = scorings;
+    stats->scorings_saved = scorings_saved;
+    stats->intents = n;
+    stats->intents_covered = num_covered;
   }
-
-  MasterMind colors("rgbcmyko", 4);
-
-  // printf("try %s\n", g_colors.substr(0,4).c_str());
-  // char result[5];
-  // scanf("%4s", result);
-  // printf("%s\n", result);
-  string target;
-  string intent;
-  getline(cin, target);
-  getline(cin, intent);
-  auto bw = colors.Evaluate(target, intent);
-  printf("%s with %s: black: %d, white: %d\n",
-         target.c_str(), intent.c_str(), bw.first, bw.second);
-  return 0;
+  MASTERMIND_STAT(stats_.intents_rated += num_rated);
+  MASTERMIND_STAT(stats_.scorings += scorings);
+  MASTERMIND_STAT(stats_.scorings_saved += scorings_saved);
+  MASTERMIND_STAT(stats_.evaluations += evaluations);
+  return PickIntent(optimal_intents);
 }
 
-int main_test_candidates(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors length\n");
-    exit(0);
+void MasterMind::ChooseIntents(const vector<Strategy>& strategies,
+                               vector<ColorComb>* intents) const {
+  assert(lazy_ || !intent_candidates_.empty());
+  // The intents of an orbit have the same ratings by every strategy, as
+  // they only depend on the sizes of the parts.
+  vector<int> representatives;
+  {
+    MASTERMIND_STAT(PhaseTimer timer(&stats_.symmetry_seconds));
+    IntentRepresentatives(&representatives);
+  }
+  DeduplicateIntents(&representatives);
+  int n = representatives.size();
+  MASTERMIND_STAT(stats_.intents_rated += n);
+  MASTERMIND_STAT(stats_.scorings += uint64_t(n) * num_targets_);
+  MASTERMIND_STAT(stats_.evaluations += uint64_t(n) * num_targets_);
+  MASTERMIND_STAT(PhaseTimer timer(&stats_.search_seconds));
+  int num_strategies = strategies.size();
+  vector<double> ratings(size_t(n) * num_strategies);
+  vector<ColorComb> representative_intents;
+  for (auto i: representatives)
+    representative_intents.push_back(IntentAt(i));
+  vector<IntentScores> scores;
+  ScoreIntents(representative_intents, &scores);
+  for (int i = 0; i < n; i++)
+    for (int k = 0; k < num_strategies; k++)
+      ratings[size_t(i) * num_strategies + k] = scores[i].Get(strategies[k]);
+  intents->clear();
+  for (int k = 0; k < num_strategies; k++) {
+    double best = ratings[k];
+    for (int i = 1; i < n; i++)
+      best = max(best, ratings[size_t(i) * num_strategies + k]);
+    vector<int> optimal_intents;
+    for (int i = 0; i < n; i++) {
+      if (ratings[size_t(i) * num_strategies + k] == best)
+        optimal_intents.push_back(representatives[i]);
+    }
+    intents->push_back(PickIntent(optimal_intents));
   }
-
-  MasterMind colors(argv[1], atoi(argv[2]));
-  for (auto it = colors.target_candidates_begin();
-       it < colors.target_candidates_end(); ++it)
-    printf("%s\n", it->c_str());
-  return 0;
 }
 
-int main_test_color_classes(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors intent\n");
-    exit(0);
+// EstimateIntent drops intents whose estimate is below the lower end of
+// the best interval by this many standard errors
+static const double kRaceConfidence = 3;
+// and doesn't rate intents on fewer targets
+static const size_t kMinSample = 16;
+
+MasterMind::ColorComb MasterMind::EstimateIntent(const SampleBudget& budget,
+                                                 SearchStats* stats) const {
+  auto start = chrono::steady_clock::now();
+  MASTERMIND_STAT(stats_.choices++);
+  if (stats)
+    *stats = SearchStats();
+  // like ChooseIntent
+  if (num_targets_ == 0)
+    return 0;
+  vector<int> representatives;
+  {
+    MASTERMIND_STAT(PhaseTimer timer(&stats_.symmetry_seconds));
+    IntentRepresentatives(&representatives);
   }
+  MASTERMIND_STAT(stats_.intents_rated += representatives.size());
+  MASTERMIND_STAT(PhaseTimer search_timer(&stats_.search_seconds));
+  size_t N = num_targets_;
+  int num_results = NumResults();
+
+  // An intent in the race, with the results counted on the sample so far
+  struct Racer {
+    int representative;
+    vector<int> counter;
+    double estimate;
+    double error;
+  };
+  vector<Racer> racers;
+  for (auto i: representatives)
+    racers.push_back(Racer{i, vector<int>(num_results, 0), 0, 0});
+
+  // The sample: targets drawn at random without repetition. Once it would
+  // contain more than half of them, all targets are counted instead.
+  mt19937_64 random(budget.seed);
+  vector<ColorComb> sample;
+  vector<ColorCounts> sample_counts;
+  vector<bool> drawn(N);
+  size_t size = 0;
+  bool all = false;
+
+  uint64_t scorings = 0;
+  // the scorings per second of the last round, which includes drawing its
+  // targets, and gets slower as the sample outgrows the caches
+  double rate = 0;
+  auto affordable = [&]() {
+    uint64_t left = budget.scorings == 0 ? numeric_limits<uint64_t>::max() :
+        budget.scorings - min(budget.scorings, scorings);
+    if (budget.seconds > 0 && rate > 0) {
+      double elapsed = chrono::duration<double>(
+          chrono::steady_clock::now() - start).count();
+      left = min(left, uint64_t(max(0.0, budget.seconds - elapsed) * rate));
+    }
+    return left;
+  };
+  // next_size grows every round, until it reaches N
+  for (size_t next_size = max<size_t>(1, min(N, budget.initial_sample));
+       size < N; next_size = max(next_size * 2, size + 1)) {
+    if (size == 0) {
+      // the first round is always completed, with a smaller sample if
+      // needed
+      uint64_t round = affordable() / max<size_t>(1, racers.size());
+      next_size = min(next_size, max(min(kMinSample, N), size_t(round)));
+    }
+    bool next_all = next_size * 2 > N &&
+        (size > 0 || racers.size() * N <= affordable());
+    if (next_all)
+      next_size = N;
+    uint64_t cost = next_all ? N : next_size - size;
+    if (size > 0 && racers.size() * cost > affordable()) {
+      size_t keep = affordable() / cost;
+      if (keep < 2)
+        break;
+      // successive halving
+      stable_sort(racers.begin(), racers.end(),
+                  [](const Racer& r1, const Racer& r2) {
+                    return r1.estimate > r2.estimate;
+                  });
+      racers.resize(keep);
+    }
 
-  MasterMind colors(argv[1], strlen(argv[2]));
-
-  vector<string> classes;
-  colors.ColorClasses(argv[2], &classes);
-  for (auto cc: classes)
-    printf("%s\n", cc.c_str());
-
-  colors.UpdateEquivalences(argv[2]);
-  printf("representative: %s\n", colors.IntentClass(argv[2]).c_str());
-  return 0;
-}
-
-int main_test_entropy(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors intent\n");
-    exit(0);
+    auto round_start = chrono::steady_clock::now();
+    if (next_all) {
+      forEachIndex(racers.size(), num_threads_, [&](int r) {
+          Racer& racer = racers[r];
+          fill(racer.counter.begin(), racer.counter.end(), 0);
+          CountResults(IntentAt(racer.representative), racer.counter.data());
+        });
+      all = true;
+    } else {
+      while (sample.size() < next_size) {
+        size_t t = random() % N;
+        if (drawn[t])
+          continue;
+        drawn[t] = true;
+        sample.push_back(implicit_targets() ? CodeAt(t) :
+                         target_candidates_[t]);
+        sample_counts.push_back(CountColors(sample.back()));
+      }
+      forEachIndex(racers.size(), num_threads_, [&](int r) {
+          Racer& racer = racers[r];
+          ColorComb intent = IntentAt(racer.representative);
+          score_batch_(sample.data() + size, sample_counts.data() + size,
+                       next_size - size, intent, CountColors(intent),
+                       num_positions_, result_index_, racer.counter.data());
+        });
+    }
+    scorings += racers.size() * cost;
+    rate = racers.size() * cost / max(1e-9, chrono::duration<double>(
+        chrono::steady_clock::now() - round_start).count());
+    size = next_size;
+
+    // The plug-in estimate of the entropy, and its standard error as a
+    // mean of -log2 p over a sample without replacement
+    double best_lower_bound = -numeric_limits<double>::infinity();
+    for (auto& racer: racers) {
+      if (all) {
+        racer.estimate = EntropyOfCounts(racer.counter.data());
+        racer.error = 0;
+        continue;
+      }
+      double entropy = 0, second_moment = 0;
+      for (auto count: racer.counter) {
+        if (count == 0)
+          continue;
+        double p = double(count) / size;
+        entropy -= p * log2(p);
+        second_moment += p * log2(p) * log2(p);
+      }
+      racer.estimate = entropy;
+      racer.error = sqrt(max(0.0, second_moment - entropy * entropy) / size *
+                         (1 - double(size) / N));
+      best_lower_bound = max(best_lower_bound,
+                             entropy - kRaceConfidence * racer.error);
+    }
+    if (all)
+      break;
+    racers.erase(remove_if(racers.begin(), racers.end(),
+                           [&](const Racer& racer) {
+                             return racer.estimate +
+                                 kRaceConfidence * racer.error <
+                                 best_lower_bound;
+                           }),
+                 racers.end());
+    if (racers.size() == 1)
+      break;
   }
 
-  MasterMind colors(argv[1], strlen(argv[2]));
-  printf("The entropy of %s when there are %lu colors is %f\n",
-         argv[2], strlen(argv[1]), colors.Entropy(string(argv[2])));
-  return 0;
+  double best = -1;
+  for (auto& racer: racers)
+    best = max(best, racer.estimate);
+  vector<int> optimal_intents;
+  for (auto& racer: racers)
+    if (racer.estimate == best)
+      optimal_intents.push_back(racer.representative);
+  sort(optimal_intents.begin(), optimal_intents.end());
+  if (stats) {
+    *stats = SearchStats();
+    stats->scorings = scorings;
+  }
+  MASTERMIND_STAT(stats_.scorings += scorings);
+  MASTERMIND_STAT(stats_.evaluations += scorings);
+  return PickIntent(optimal_intents);
 }
 
-int main_test_choose(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors length\n");
-    exit(0);
+// Moves the elements of data[0,..,n) with keep[i] set to the front and the
+// others after them, both in their original order, and returns the number
+// kept. scratch must have room for n elements.
+template <typename T>
+static size_t StablePartition(T* data, size_t n, const uint8_t* keep,
+                              uint64_t* scratch) {
+  size_t num_kept = 0, num_removed = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (keep[i])
+      data[num_kept++] = data[i];
+    else
+      scratch[num_removed++] = data[i];
   }
+  for (size_t i = 0; i < num_removed; i++)
+    data[num_kept + i] = static_cast<T>(scratch[i]);
+  return num_kept;
+}
 
-  MasterMind colors(argv[1], atoi(argv[2]));
-  printf("You could try %s\n", colors.ChooseIntent().c_str());
-  return 0;
+// The inverse of StablePartition: interleaves data[0,..,num_kept) and
+// data[num_kept,..,n) such that element i is taken from the first range if
+// from_kept[i] is set.
+template <typename T>
+static void Unpartition(T* data, size_t n, size_t num_kept,
+                        const uint8_t* from_kept, uint64_t* scratch) {
+  for (size_t i = 0; i < num_kept; i++)
+    scratch[i] = data[i];
+  // never overwrites elements of the second range that are still to be read
+  size_t kept = 0, removed = num_kept;
+  for (size_t i = 0; i < n; i++)
+    data[i] = from_kept[i] ? static_cast<T>(scratch[kept++]) : data[removed++];
 }
 
-int main_partitions(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind n k\n");
-    exit(0);
+// Sets the flags for Unpartition for the elements of data[0,..,n) that
+// StablePartition split into two increasing ranges, such that it restores
+// their increasing order.
+template <typename T>
+static void MergeFlags(const T* data, size_t n, size_t num_kept,
+                       uint8_t* from_kept) {
+  size_t kept = 0, removed = num_kept;
+  for (size_t i = 0; i < n; i++) {
+    from_kept[i] = removed == n ||
+        (kept < num_kept && data[kept] < data[removed]);
+    if (from_kept[i])
+      kept++;
+    else
+      removed++;
   }
-
-  vector<vector<int>> partition_list;
-  partitions(atoi(argv[1]), atoi(argv[2]), &partition_list);
-
-  for (auto part: partition_list) {
-    for (auto elt: part)
-      cout << elt << " + ";
-    cout << endl;
-  }    
-  return 0;
 }
 
-int main_test_choose_initial(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind colors length\n");
-    exit(0);
+void MasterMind::PruneIntents(PruneStats* stats) {
+  // The colors of none of the targets, except for the first one as a filler:
+  // it gives the same results as any other one, and is smaller.
+  ColorCounts present = 0;
+  for (size_t i = 0; i < num_targets_; i++)
+    present |= target_counts_[i];
+  ColorCounts absent = 0;
+  bool filler = false;
+  for (size_t c = 0; c < colors_.size(); c++) {
+    if (((present >> (4 * c)) & 0xF) == 0) {
+      if (filler)
+        absent |= ColorCounts(0xF) << (4 * c);
+      filler = true;
+    }
   }
 
-  MasterMind colors(argv[1], atoi(argv[2]));
-  vector<int> intent_class = colors.ChooseInitialIntent();
-  
-  cout << "You could try any string with the following grouping of colors: ";
-  int last = intent_class.back();
-  intent_class.pop_back();
-  for (auto num: intent_class)
-    cout << num << ",";
-  cout << last << endl;
-  return 0;
+  for (size_t k = 0; k < num_intents_; k++) {
+    ColorComb intent = intent_candidates_[intent_indices_[k]];
+    target_flags_[k] = (CountColors(intent) & absent) == 0;
+    if (!target_flags_[k])
+      stats->absent_colors++;
+  }
+  num_intents_ = StablePartition(intent_indices_.data(), num_intents_,
+                                 target_flags_.data(), target_scratch_.data());
 }
 
-int main_test_update(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc != 5) {
-    std::printf("Usage: mastermind colors intent black white\n");
-    exit(0);
+void MasterMind::DeduplicateIntents(vector<int>* representatives) const {
+  if (!prune_intents_ || lazy_ || duplicates_.empty())
+    return;
+  MASTERMIND_STAT(PhaseTimer timer(&stats_.prune_seconds));
+  // A duplicate still partitions the targets left like the smaller intent,
+  // and still isn't a possible target
+  for (auto& found: duplicates_) {
+    if (found.intents.empty())
+      continue;
+    representatives->erase(
+        remove_if(representatives->begin(), representatives->end(),
+                  [&](int i) {
+                    return binary_search(found.intents.begin(),
+                                         found.intents.end(), i);
+                  }),
+        representatives->end());
   }
-
-  MasterMind colors(argv[1], strlen(argv[2]));
-  int black = atoi(argv[3]), white = atoi(argv[4]);
-  
-  printf("There are %d possible targets\n", colors.num_candidates());
-  printf("The entropy (expected information gain) of your intent is %.2f bits\n",
-         colors.Entropy(argv[2]));
-  
-  double information = colors.Update(argv[2], black, white);
-  printf("There are %d possible targets left\n", colors.num_candidates());
-  printf("You gained %.2f bits of information\n", information);
-  for (auto it = colors.target_candidates_begin();
-       it != colors.target_candidates_end(); ++it)
-    cout << *it << ' ';
-  cout << endl;
-  return 0;
+  Duplicates& last = duplicates_.back();
+  // With a single target there is nothing to choose
+  if (last.found || num_targets_ <= 1 ||
+      num_targets_ > kMaxTargetsToDeduplicate)
+    return;
+  last.found = true;
+
+  // Representatives that aren't possible targets, and partition the targets
+  // like a smaller one, give the same entropy as it. The partitions are
+  // compared as strings of results, relabeled in order of first appearance,
+  // stored one after the other and found by their hashes in an open
+  // addressing table. Only the representatives are compared; the other
+  // intents are compared once they represent their orbits.
+  size_t num_slots = 2;
+  while (num_slots < 2 * representatives->size())
+    num_slots *= 2;
+  vector<int> slots(num_slots, -1);
+  vector<uint8_t> partitions;
+  partitions.reserve(representatives->size() * num_targets_);
+  size_t num_representatives = 0;
+  for (auto index: *representatives) {
+    ColorComb intent = intent_candidates_[index];
+    ColorCounts intent_counts = CountColors(intent);
+    const uint8_t* row = score_table_ ? score_table_->row(index) : nullptr;
+    int8_t label[256];
+    fill(label, label + NumResults(), -1);
+    int num_labels = 0;
+    size_t offset = partitions.size();
+    uint64_t hash = 0;
+    for (size_t i = 0; i < num_targets_; i++) {
+      int result = row ? row[target_indices_[i]] :
+          EvaluationNumerical_(target_candidates_[i], target_counts_[i],
+                               intent, intent_counts);
+      if (label[result] < 0)
+        label[result] = num_labels++;
+      partitions.push_back(label[result]);
+      hash = (hash ^ label[result]) * 0x100000001b3;
+    }
+    size_t slot = (hash ^ (hash >> 32)) & (num_slots - 1);
+    while (slots[slot] >= 0 &&
+           !equal(partitions.begin() + offset, partitions.end(),
+                  partitions.begin() + size_t(slots[slot]) * num_targets_))
+      slot = (slot + 1) & (num_slots - 1);
+    bool unique = slots[slot] < 0;
+    if (unique)
+      slots[slot] = offset / num_targets_;
+    else
+      partitions.resize(offset);
+    if (unique ||
+        binary_search(target_candidates_begin(), target_candidates_end(),
+                      intent))
+      (*representatives)[num_representatives++] = index;
+    else
+      last.intents.push_back(index);
+  }
+  MASTERMIND_STAT(stats_.evaluations +=
+                  uint64_t(representatives->size()) * num_targets_);
+  representatives->resize(num_representatives);
+  MASTERMIND_STAT(stats_.intents_pruned += last.intents.size());
 }
 
-int MasterMind::test_to_from_string(const string& colors,
-                                    const string& colorcomb_s,
-                                    const string& colorstring) {
-  MasterMind cc2string(colors, colorcomb_s.size());
-  MasterMind string2cc(colors, colorstring.size());
-  ColorComb colorcomb;
-  for (auto c: colorcomb_s) {
-    colorcomb.push_back(c - '0');
+double MasterMind::Update(ColorComb intent, int black, int white) {
+  MASTERMIND_STAT(PhaseTimer timer(&stats_.update_seconds));
+  int result = EvaluationIndex_(black, white);
+  ColorCounts intent_counts = CountColors(intent);
+  const uint8_t* row =
+      score_table_ ? score_table_->row(CodeIndex(intent)) : nullptr;
+  size_t old_num_targets = num_targets_;
+  // the first Update of the lazy engine
+  bool generate = implicit_targets();
+  if (generate) {
+    constraints_.Add(intent, black, white);
+    GenerateTargets();
+  } else if (partition_masks_) {
+    // intersect with the mask of the result, and keep the targets whose bit
+    // is still set
+    const uint64_t* masks = partition_masks_->intent_masks(CodeIndex(intent));
+    int num_results = partition_masks_->num_results;
+    size_t num_live_words = 0;
+    for (auto w: live_words_) {
+      live_targets_[w] &= masks[w * num_results + result];
+      if (live_targets_[w] != 0)
+        live_words_[num_live_words++] = w;
+    }
+    live_words_.resize(num_live_words);
+    for (size_t i = 0; i < old_num_targets; i++) {
+      uint32_t t = target_indices_[i];
+      target_flags_[i] = (live_targets_[t / 64] >> (t % 64)) & 1;
+    }
+  } else {
+    for (size_t i = 0; i < old_num_targets; i++) {
+      int target_result = row ? row[target_indices_[i]] :
+          EvaluationNumerical_(target_candidates_[i], target_counts_[i],
+                               intent, intent_counts);
+      target_flags_[i] = target_result == result;
+    }
   }
-  auto s = cc2string.cc2string(colorcomb);
-  printf("%s corresponds to %s\n", colorcomb_s.c_str(), s.c_str());
-
-  auto cc = string2cc.string2cc(colorstring);
-  string cc_s;
-  for (auto i: cc) {
-    cc_s.push_back(i + '0');
+  if (!generate) {
+    num_targets_ = StablePartition(target_candidates_.data(), old_num_targets,
+                                   target_flags_.data(),
+                                   target_scratch_.data());
+    StablePartition(target_counts_.data(), old_num_targets,
+                    target_flags_.data(), target_scratch_.data());
+    if (!target_indices_.empty())
+      StablePartition(target_indices_.data(), old_num_targets,
+                      target_flags_.data(), target_scratch_.data());
   }
-  
-  printf("%s corresponds to %s\n", colorstring.c_str(), cc_s.c_str());
 
-  return 0;
+  undo_stack_.emplace_back();
+  duplicates_.emplace_back();
+  undo_stack_.back().num_targets = old_num_targets;
+  undo_stack_.back().num_intents = num_intents_;
+  if (prune_intents_ && !lazy_) {
+    MASTERMIND_STAT(PhaseTimer prune_timer(&stats_.prune_seconds));
+    PruneStats& prune_stats = undo_stack_.back().prune_stats;
+    PruneIntents(&prune_stats);
+    MASTERMIND_STAT(stats_.intents_pruned += prune_stats.absent_colors);
+  }
+  if (exist_equivalences())
+    undo_stack_.back().color_class_list = color_class_list_;
+  UpdateEquivalences(cc2string(intent));
+  intents_.push_back(intent);
+  MASTERMIND_STAT(stats_.updates++);
+  MASTERMIND_STAT(stats_.targets_before += old_num_targets);
+  MASTERMIND_STAT(stats_.targets_after += num_targets_);
+  MASTERMIND_STAT(stats_.targets_scored += generate ? 0 : old_num_targets);
+  MASTERMIND_STAT(stats_.evaluations += generate ? 0 : old_num_targets);
+  return log2(static_cast<double>(old_num_targets) / num_targets_);
 }
 
-int main_test_to_from_string(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 4) {
-    std::printf("Usage: mastermind colors colornum colorstring\n");
-    exit(0);
+void MasterMind::GenerateTargets() {
+  // The threads take the codes starting with the same colors at the first
+  // positions, as many as it takes for every thread to get several chunks
+  // of forEachIndex, and append them in increasing order afterwards.
+  int prefix_length = 0;
+  size_t num_prefixes = 1;
+  while (prefix_length < num_positions_ && num_prefixes < 256 * size_t(num_threads_)) {
+    prefix_length++;
+    num_prefixes *= colors_.size();
   }
-
-  return MasterMind::test_to_from_string(argv[1], argv[2], argv[3]);
+  vector<vector<ColorComb>> block_targets(num_prefixes);
+  forEachIndex(num_prefixes, num_threads_, [&](int index) {
+      int p = index;
+      ColorComb prefix = 0;
+      for (int i = 0; i < prefix_length; i++, p /= colors_.size())
+        prefix |= ColorComb(p % colors_.size()) << (4 * i);
+      constraints_.Generate(prefix, prefix_length, &block_targets[index]);
+    });
+  target_candidates_.clear();
+  for (auto& targets: block_targets)
+    target_candidates_.insert(target_candidates_.end(), targets.begin(),
+                              targets.end());
+  num_targets_ = target_candidates_.size();
+  target_counts_.clear();
+  for (auto target: target_candidates_)
+    target_counts_.push_back(CountColors(target));
+  if (score_table_) {
+    target_indices_.clear();
+    for (auto target: target_candidates_)
+      target_indices_.push_back(CodeIndex(target));
+  }
+  target_flags_.resize(num_targets_);
+  target_scratch_.resize(num_targets_);
 }
 
-int main_test_intersect(int argc, char *argv[]) {
-// int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    std::printf("Usage: mastermind string1 string2\n");
-    exit(0);
+void MasterMind::Undo() {
+  assert(!undo_stack_.empty());
+  UpdateRecord& record = undo_stack_.back();
+  size_t n = record.num_targets;
+  if (lazy_ && undo_stack_.size() == 1) {
+    // back to all codes, and free the memory of the targets
+    for (auto* v: {&target_candidates_, &target_counts_, &target_scratch_}) {
+      v->clear();
+      v->shrink_to_fit();
+    }
+    target_indices_ = vector<uint32_t>();
+    target_flags_ = vector<uint8_t>();
+  } else if (partition_masks_) {
+    for (size_t i = num_targets_; i < n; i++)
+      live_targets_[target_indices_[i] / 64] |=
+          uint64_t(1) << (target_indices_[i] % 64);
+    live_words_.clear();
+    for (size_t w = 0; w < live_targets_.size(); w++)
+      if (live_targets_[w] != 0)
+        live_words_.push_back(w);
+  }
+  if (!lazy_ || undo_stack_.size() > 1) {
+    MergeFlags(target_candidates_.data(), n, num_targets_,
+               target_flags_.data());
+    Unpartition(target_candidates_.data(), n, num_targets_,
+                target_flags_.data(), target_scratch_.data());
+    Unpartition(target_counts_.data(), n, num_targets_,
+                target_flags_.data(), target_scratch_.data());
+    if (!target_indices_.empty())
+      Unpartition(target_indices_.data(), n, num_targets_,
+                  target_flags_.data(), target_scratch_.data());
+  }
+  num_targets_ = n;
+
+  if (record.num_intents != num_intents_) {
+    MergeFlags(intent_indices_.data(), record.num_intents, num_intents_,
+               target_flags_.data());
+    Unpartition(intent_indices_.data(), record.num_intents, num_intents_,
+                target_flags_.data(), target_scratch_.data());
+    num_intents_ = record.num_intents;
   }
 
-  printf("%s\n", intersect(argv[1], argv[2]).c_str());
-  return 0;
+  if (!record.color_class_list.empty()) {
+    swap(color_class_list_, record.color_class_list);
+    BuildColorClassIndex();
+  }
+  undo_stack_.pop_back();
+  duplicates_.pop_back();
+  intents_.pop_back();
+  if (implicit_targets())
+    constraints_.RemoveLast();
 }
-
@@ -2,20 +2,21 @@
 #ifndef MASTERMIND_H_
 #define MASTERMIND_H_
 
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <string>
-// #include <algorithm>
+#include <thread>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 
-/*
-  Future improvements:
-  - remove intents that will not give extra information
-    for example remove colors that cannot be in the target, leaving one if
-    empty spots are not allowed
-  - The greedy approach implemented here is not necessarily optimal: an
-    option of maximal entropy is chosen, but the outcomes may each have
-    inferior follow up entropies to a non-maximal entropy intent.
- */
+#include "constraints.h"
+#include "decision_cache.h"
+#include "scoring.h"
 
 /*
 template <typename T>
@@ -38,21 +39,260 @@ int IntersectionSize(const S& s1, const S& s2) {
 void partitions(int n, int k, std::vector<std::vector<int>>* result);
 std::string intersect(const std::string& s1, const std::string& s2);
 
+// The results of all pairs of combinations for a number of colors and
+// positions, as EvaluationIndex_ of their evaluation, indexed by
+// MasterMind::CodeIndex: the result of intent i and target t is
+// results[i * num_codes + t].
+struct ScoreTable {
+  int num_colors;
+  int num_positions;
+  size_t num_codes;
+  const uint8_t* results;
+  // keeps the memory results points to alive, e.g. a vector or a mapped file
+  std::shared_ptr<const void> storage;
+
+  const uint8_t* row(size_t intent_index) const {
+    return results + intent_index * num_codes;
+  }
+};
+
+// For every intent and every result, the set of codes for which the intent
+// gets that result, as a bitset over MasterMind::CodeIndex. The bits of the
+// codes 64w,..,64w+63 for result r of intent i are in
+// masks[(i * num_words + w) * num_results + r], so that the masks of a word
+// are adjacent.
+struct PartitionMasks {
+  size_t num_codes;
+  size_t num_words;
+  int num_results;
+  std::vector<uint64_t> masks;
+
+  const uint64_t* intent_masks(size_t intent_index) const {
+    return masks.data() + intent_index * num_words * num_results;
+  }
+};
+
 class MasterMind {
+ public:
+  // A color combination, packed as one 4-bit color index per position.
+  // Position 0 is stored in the most significant nibble that is used, so that
+  // the numerical order of combinations is their lexicographical order (in
+  // the order of colors_), which is also the order in which they are
+  // generated.
+  using ColorComb = uint64_t;
+
+  // The number of occurrences of every color in a combination, packed as one
+  // 4-bit count per color index, color c in bits 4c,..,4c+3.
+  using ColorCounts = uint64_t;
+
+  static const int kMaxColors = 16;
+  static const int kMaxPositions = 15;
+
+  // Whether there can be a game of these colors and number of positions:
+  // 1 to kMaxColors distinct colors, and 1 to kMaxPositions positions.
+  static bool Valid(const std::string& colors, int num_positions);
+
+  // How the possible targets are represented:
+  // - kVectors: a sorted list, the results of an intent are counted by
+  //   scoring it against all of them (or by looking them up in the score
+  //   table)
+  // - kBitsets: additionally a bitset over all codes, the results are
+  //   counted by intersecting it with the PartitionMasks of the intent. This
+  //   is faster, but the masks take num_codes^2 * NumResults() bits, so it
+  //   is only used if they take at most kPartitionMasksBudget bytes, e.g.
+  //   up to 6 colors and 5 positions.
+  // - kLazy: like kVectors, but the codes aren't generated up front, so
+  //   that memory scales with the possible targets rather than with
+  //   num_codes(), e.g. for 10 colors and 8 positions. Until the first
+  //   Update, the possible targets are all codes, enumerated by CodeIndex
+  //   when needed; the first Update generates the ones that remain from
+  //   its Constraints, without scoring all codes, and stores those. The
+  //   intents are generated from their indices, and the searches only
+  //   generate the representatives of their orbits, see
+  //   IntentRepresentatives. Intents aren't pruned.
+  enum class Engine { kVectors, kBitsets, kLazy };
+  static const size_t kPartitionMasksBudget = size_t(256) << 20;
+
+  // How intents are rated by ChooseIntent and ChooseInitialIntent, all by
+  // the sizes of the parts into which they split the possible targets:
+  // - kEntropy: the entropy of the partition, the default
+  // - kMinimax: the size of the largest part, the smaller the better
+  //   (Knuth's worst case strategy)
+  // - kMostParts: the number of parts
+  // - kExpectedSize: the expected size of the part of the target, the
+  //   smaller the better
+  enum class Strategy { kEntropy, kMinimax, kMostParts, kExpectedSize };
+  static const int kNumStrategies = 4;
+  static const char* StrategyName(Strategy strategy);
+  // Sets *strategy to the one called name by StrategyName, or returns
+  // false if there is none.
+  static bool ParseStrategy(const std::string& name, Strategy* strategy);
+
+  // The ratings of an intent by all strategies
+  struct IntentScores {
+    double entropy;
+    int largest_part;
+    int num_parts;
+    double expected_size;
+
+    // The rating by strategy, the higher the better
+    double Get(Strategy strategy) const;
+  };
+
  private:
   std::string colors_;
   int num_positions_;
-  unordered_map<char, int> color_index_;
-  using ColorComb = std::vector<char>;
-  std::string cc2string(const ColorComb& cc) const;
-  ColorComb string2cc(const std::string& s) const;
-  
-  // candidates for targets that are still possible
-  //std::vector<ColorComb> target_candidates_;
-  std::vector<std::string> target_candidates_;
-  // candidates for (high information yielding) intents.
-  //std::vector<ColorComb> intent_candidates_;
-  std::vector<std::string> intent_candidates_;
+  std::unordered_map<char, int> color_index_;
+  // the lowest bit of the nibble of every position
+  ColorComb position_bits_;
+  // The evaluation of the lazy engine's first Update, which generates the
+  // targets from it. The other Updates score the targets left instead:
+  // scoring a target costs less than checking it against the allowed colors
+  // and bounds, which rarely reject it.
+  Constraints constraints_;
+
+  // All targets, of which the first num_targets_ are still possible, in
+  // increasing order. The ones eliminated by the last Update follow those,
+  // in increasing order as well, then the ones eliminated by the Update
+  // before, etc., so that Undo can merge them back.
+  // With the lazy engine, it is empty until the first Update, and then
+  // only contains the targets that remained after it.
+  std::vector<ColorComb> target_candidates_;
+  size_t num_targets_;
+  // target_counts_[i] = CountColors(target_candidates_[i])
+  std::vector<ColorCounts> target_counts_;
+  // target_indices_[i] = CodeIndex(target_candidates_[i]), only maintained
+  // when there is a score table or with the bitset engine.
+  std::vector<uint32_t> target_indices_;
+  // Only for the bitset engine: the masks, the bitset of the first
+  // num_targets_ target_indices_, and the indices of its words that aren't 0.
+  std::shared_ptr<const PartitionMasks> partition_masks_;
+  std::vector<uint64_t> live_targets_;
+  std::vector<uint32_t> live_words_;
+  CountMasksFunction count_masks_;
+  // Sets live_targets_ and live_words_ from target_indices_
+  void BuildLiveTargets();
+  // The lazy engine, see Engine
+  bool lazy_;
+
+  // Scratch space of the size of target_candidates_ for Update and Undo, so
+  // that they don't allocate.
+  std::vector<uint8_t> target_flags_;
+  std::vector<uint64_t> target_scratch_;
+
+  // If not null, results are looked up instead of computed.
+  std::shared_ptr<const ScoreTable> score_table_;
+  // candidates for (high information yielding) intents: all combinations,
+  // so that intent_candidates_[CodeIndex(cc)] = cc. Empty with the lazy
+  // engine.
+  std::vector<ColorComb> intent_candidates_;
+  ColorComb IntentAt(size_t index) const {
+    return lazy_ ? CodeAt(index) : intent_candidates_[index];
+  }
+  // The indices in intent_candidates_ of the intents that haven't been
+  // pruned are the first num_intents_, in increasing order, followed by the
+  // ones pruned by the last Update etc., like target_candidates_.
+  std::vector<int> intent_indices_;
+  size_t num_intents_;
+  bool prune_intents_;
+
+ public:
+  // The numbers of intents pruned after an Update because they contain a
+  // color that none of the possible targets has (other than the one kept as
+  // a filler), by the Update, and of representatives skipped because they
+  // partition the possible targets like a smaller one, by the first
+  // ChooseIntent that searches for an intent, see DeduplicateIntents.
+  struct PruneStats {
+    int absent_colors = 0;
+    int duplicates = 0;
+  };
+
+  // What a game did since it was created or ResetStats was called, with
+  // the wall time of its phases:
+  // - Updates, with the sums of the numbers of possible targets before and
+  //   after them, the targets they scored, and the intents they pruned
+  // - ChooseIntent and ChooseInitialIntent, with the intents they rated,
+  //   the targets they scored them against, the ones saved by bounded
+  //   search, and the intents found in the decision cache
+  // - the evaluations of all of these
+  struct Stats {
+    uint64_t updates = 0;
+    uint64_t targets_before = 0;
+    uint64_t targets_after = 0;
+    // all targets before, except for the first Update of the lazy engine,
+    // which generates the targets left
+    uint64_t targets_scored = 0;
+    uint64_t intents_pruned = 0;
+    double update_seconds = 0;
+    // part of update_seconds, plus the deduplication by ChooseIntent
+    double prune_seconds = 0;
+
+    uint64_t choices = 0;
+    uint64_t decision_cache_hits = 0;
+    uint64_t intents_rated = 0;
+    // of the intents, and of the bounds, which count the common colors of
+    // an intent with every class of color counts of the targets
+    uint64_t scorings = 0;
+    uint64_t scorings_saved = 0;
+
+    // The results of an intent for a target that the game computed, looked
+    // up in the score table or counted in the partition masks, i.e. the
+    // calls of Evaluate that these spare: in Updates, searches (without
+    // the bounds) and deduplication. Evaluate, Entropy and Scores aren't
+    // counted when called directly, e.g. by Solver, OpeningBook::Build or
+    // mastermind-sim: they are const, and Solver calls them on several
+    // threads.
+    uint64_t evaluations = 0;
+    // finding the intents to rate, their bounds, and rating them
+    double symmetry_seconds = 0;
+    double bound_seconds = 0;
+    double search_seconds = 0;
+
+    // Adds the numbers of other
+    void Add(const Stats& other);
+    // The numbers that aren't 0, on one line
+    std::string Report() const;
+  };
+
+ private:
+  // Unlike the intents with absent colors, which every Update prunes,
+  // duplicates are only looked for by searches without limits (for which
+  // the time is better spent rating intents), and only once there are 2
+  // to this many possible targets. Finding them costs about as much per
+  // representative as rating it, and saves computing the bounds of the
+  // duplicates and rating them, in this search and the ones that follow,
+  // which only pays off with few targets: mastermind-sim takes as long as
+  // without it with 16 (8 colors and 4 positions) or less time (6 colors),
+  // and 60% longer with 256.
+  static const size_t kMaxTargetsToDeduplicate = 16;
+
+  // Removes the intents with absent colors from the first num_intents_
+  // intent_indices_.
+  void PruneIntents(PruneStats* stats);
+  // Removes the representatives that partition the possible targets like a
+  // smaller one from *representatives: the ones found after the earlier
+  // Updates, which still do, and after the last one, which it looks for
+  // the first time it is called after it, see kMaxTargetsToDeduplicate.
+  void DeduplicateIntents(std::vector<int>* representatives) const;
+  // The duplicates found after every Update, in increasing order, and
+  // whether they were looked for. This is a cache of the searches, which
+  // is why it is mutable: it doesn't change the intents they choose, nor
+  // the game's intents, representatives or what Undo restores.
+  struct Duplicates {
+    bool found = false;
+    std::vector<int> intents;
+  };
+  mutable std::vector<Duplicates> duplicates_;
+
+  // What Undo needs to restore for every Update. The color classes are
+  // only saved while there are equivalences.
+  struct UpdateRecord {
+    size_t num_targets;
+    size_t num_intents;
+    PruneStats prune_stats;
+    std::vector<std::string> color_class_list;
+  };
+  std::vector<UpdateRecord> undo_stack_;
 
   // Early on, we can a priori say that permuting some colors will not
   // change the information content:
@@ -66,9 +306,60 @@ class MasterMind {
   const std::string& ColorClass(char color) const;
 
   void BuildColorClassIndex();
-  
+
+  // The intents of all Updates so far, in order.
+  std::vector<ColorComb> intents_;
+  // Whether ChooseIntent only evaluates one intent of every orbit of
+  // symmetries.
+  bool use_symmetries_;
+  // Whether ChooseIntent abandons intents that can't be optimal
+  bool bounded_search_;
+  Strategy strategy_;
+
+  // A permutation of positions and colors, mapping cc to the combination
+  // with color colors[Color(cc, positions[i])] at position i. Such a
+  // symmetry doesn't change evaluations: applying it to both target and
+  // intent gives the same black and white.
+  struct Symmetry {
+    int positions[kMaxPositions];
+    int colors[kMaxColors];
+  };
+  ColorComb Apply(const Symmetry& symmetry, ColorComb cc) const {
+    ColorComb result = 0;
+    for (int i = 0; i < num_positions_; i++)
+      result = (result << 4) |
+          symmetry.colors[Color(cc, symmetry.positions[i])];
+    return result;
+  }
+
+  // Sets *generators to a set of symmetries generating the group of those
+  // that map every intent in intents_ to itself. They also map the possible
+  // targets to themselves, so an intent and its images have the same
+  // entropy.
+  // The symmetries that permute the colors used in intents_ are found by a
+  // search with a limited number of steps. When it runs out, the generators
+  // may only generate a subgroup, which is fine for ChooseIntent.
+  void SymmetryGenerators(std::vector<Symmetry>* generators) const;
+
   // generates all possible targets in target_candidates_
-  void GenerateTargetCandidates(int length=-1, const std::string& prefix="");
+  void GenerateTargetCandidates();
+  // Sets codes[i] to the code of index first + i, and counts[i] to its
+  // color counts, for i = 0,..,n-1.
+  void GenerateCodes(size_t first, size_t n, ColorComb* codes,
+                     ColorCounts* counts) const;
+  // Calls f(block, first, codes, counts, n) for the consecutive blocks of
+  // all codes, where codes are the n codes from index first on, on
+  // num_threads threads. With one thread, the blocks come in increasing
+  // order.
+  template <typename Function>
+  void ForEachCodeBlock(int num_threads, Function f) const;
+  // The first Update of the lazy engine: stores the codes that get its
+  // evaluation, generated by constraints_.
+  void GenerateTargets();
+  // Whether cc is one of the possible targets
+  bool IsPossibleTarget(ColorComb cc) const;
+  // IntentRepresentatives for the lazy engine, which generates them
+  void GenerateIntentRepresentatives(std::vector<int>* representatives) const;
   
   // convert a possible evaluation (number of black/white) to an integer value
   // numbered from 0,..,N-1 where N = num_results(). Note that N-2 corresponds
@@ -76,34 +367,212 @@ class MasterMind {
   int EvaluationIndex_(int black, int white) const {
     return (black * (2 * num_positions_ + 3 - black)) / 2 + white;
   }  
-  int EvaluationNumerical_(const std::string& target, const std::string& intent) const;
+  int EvaluationNumerical_(ColorComb target, ColorComb intent) const;
+  int EvaluationNumerical_(ColorComb target, ColorCounts target_counts,
+                           ColorComb intent, ColorCounts intent_counts) const {
+    int black, white;
+    std::tie(black, white) = Evaluate(target, target_counts, intent, intent_counts);
+    return EvaluationIndex_(black, white);
+  }
 
   // The total number of possible evaluations of an intent (counting all but one
   // black, and a single white). 
   int NumResults() const { return EvaluationIndex_(num_positions_ + 1, 0); }
 
+  // result_index_[16 * black + black + white] = EvaluationIndex_(black, white),
+  // as used by the batch scoring functions.
+  uint8_t result_index_[16 * 16];
+  ScoreBatchFunction score_batch_;
+
+  // the number of threads used to search for intents
+  int num_threads_;
+
+  // Scores the intent against all target candidates, incrementing
+  // counter[EvaluationIndex_(black, white)] for each of them.
+  void CountResults(ColorComb intent, int* counter) const;
+
+  // The entropy of the results counted in counter, for all targets. It is
+  // summed in fixed point, so it is exactly the same for every order of
+  // the counts.
+  double EntropyOfCounts(const int* counter) const;
+  // All ratings of the results counted in counter, with EntropyOfCounts
+  IntentScores ScoresOfCounts(const int* counter) const;
+  // Sets (*scores)[i] to Scores(intents[i]), on num_threads_ threads. While
+  // the lazy engine's targets are implicit, it generates them once for all
+  // intents.
+  void ScoreIntents(const std::vector<ColorComb>& intents,
+                    std::vector<IntentScores>* scores) const;
+
+  // What BoundedEntropy needs to know about the possible targets: black +
+  // white only depends on the color counts of intent and target, and there
+  // are far fewer distinct color counts than targets.
+  struct BoundData {
+    // the distinct color counts of the targets, and how many have them
+    std::vector<std::pair<ColorCounts, int>> color_counts;
+    // results[c] are the EvaluationIndex_ of the results with c common
+    // colors, i.e. black + white = c
+    std::vector<std::vector<int>> results;
+  };
+  void GetBoundData(BoundData* data) const;
+  // Sets num_common[c] to the number of targets with c common colors with
+  // the intent, for c = 0,..,num_positions_.
+  void CountCommon(ColorComb intent, const BoundData& data,
+                   int* num_common) const;
+  // An upper bound of the entropy when some targets have been counted in
+  // counter, and num_common[c] is the total number of targets with c common
+  // colors: the entropy if the others are spread as evenly as possible over
+  // the results with their number of common colors.
+  double EntropyUpperBound(const BoundData& data, const int* num_common,
+                           const int* counter) const;
+  // Entropy(intent), unless it is less than threshold: it scores blocks of
+  // targets, and returns the upper bound once that is less than threshold
+  // (by more than a rounding error). num_common are the counts of
+  // CountCommon. Sets *num_scored to the number of targets scored.
+  double BoundedEntropy(ColorComb intent, double threshold,
+                        const BoundData& data, const int* num_common,
+                        size_t* num_scored) const;
+
+  // updated by const functions too, but only on the calling thread
+  mutable Stats stats_;
+
+  // If not null, ChooseIntent looks up and stores its intents here.
+  std::shared_ptr<DecisionCache> decision_cache_;
+  // The key of the possible targets and the strategy
+  DecisionCache::Key DecisionKey() const;
+
   // Return optimal intent candidate that is also a possible target.
   // If non of the optimal candidates is a possible target, just return
   // any of them
-  std::string PickIntent(const std::vector<int>& optimal_intents) const;
+  ColorComb PickIntent(const std::vector<int>& optimal_intents) const;
+
+  // colors, or throws invalid_argument unless Valid(colors, num_positions)
+  static const std::string& ValidColors(const std::string& colors,
+                                        int num_positions);
 
  public:
-  MasterMind(const std::string& colors, int num_positions)
-      : colors_(colors),
-        num_positions_(num_positions) {
+  // Throws invalid_argument unless Valid(colors, num_positions), before
+  // anything is packed in nibbles.
+  MasterMind(const std::string& colors, int num_positions,
+             Engine engine = Engine::kVectors)
+      : colors_(ValidColors(colors, num_positions)),
+        num_positions_(num_positions),
+        position_bits_(0),
+        constraints_(colors.size(), num_positions),
+        count_masks_(BestCountMasks()),
+        lazy_(engine == Engine::kLazy),
+        prune_intents_(true),
+        use_symmetries_(true),
+        bounded_search_(true),
+        strategy_(Strategy::kEntropy),
+        result_index_(),
+        score_batch_(BestScoreBatch()),
+        num_threads_(std::max(1u, std::thread::hardware_concurrency())) {
+    for (int i = 0; i < num_positions_; i++)
+      position_bits_ = (position_bits_ << 4) | 1;
+    for (int black = 0; black <= num_positions_; black++)
+      for (int white = 0; black + white <= num_positions_; white++)
+        result_index_[16 * black + black + white] =
+            EvaluationIndex_(black, white);
     color_class_list_ = {colors_};
-    for (int i = 0; i < colors_.size(); i++) {
+    for (size_t i = 0; i < colors_.size(); i++) {
       color_index_[colors_[i]] = i;
       color_class_index_[colors_[i]] = 0;
     }
     
+    if (lazy_) {
+      num_targets_ = num_codes();
+      num_intents_ = num_targets_;
+      return;
+    }
     GenerateTargetCandidates();
     intent_candidates_ = target_candidates_; // deep copy
+    num_targets_ = target_candidates_.size();
+    num_intents_ = intent_candidates_.size();
+    for (size_t i = 0; i < num_intents_; i++)
+      intent_indices_.push_back(i);
+    target_flags_.resize(num_targets_);
+    target_scratch_.resize(num_targets_);
+    if (engine == Engine::kBitsets) {
+      partition_masks_ = BuildPartitionMasks(kPartitionMasksBudget);
+      if (partition_masks_) {
+        for (auto target: target_candidates_)
+          target_indices_.push_back(CodeIndex(target));
+        BuildLiveTargets();
+      }
+    }
+  }
+
+  // kBitsets only if it was requested and the masks fit in the budget.
+  Engine engine() const {
+    return lazy_ ? Engine::kLazy :
+        partition_masks_ ? Engine::kBitsets : Engine::kVectors;
   }
+  // Returns the masks of all intents, or null if they would take more than
+  // memory_budget bytes.
+  std::shared_ptr<const PartitionMasks> BuildPartitionMasks(
+      size_t memory_budget) const;
   
   int num_positions() const { return num_positions_; }
   const std::string& colors() const { return colors_; }
 
+  // The implementation of batch scoring, by default the fastest one that the
+  // cpu supports.
+  ScoreBatchFunction score_batch() const { return score_batch_; }
+  void set_score_batch(ScoreBatchFunction score_batch) {
+    score_batch_ = score_batch;
+  }
+
+  // The index of a combination in the list of all combinations in increasing
+  // order, i.e. its value in base colors().size().
+  size_t CodeIndex(ColorComb cc) const {
+    size_t index = 0;
+    for (int i = 0; i < num_positions_; i++)
+      index = index * colors_.size() + Color(cc, i);
+    return index;
+  }
+  // The combination of the given index, the inverse of CodeIndex
+  ColorComb CodeAt(size_t index) const {
+    ColorComb cc = 0;
+    for (int i = 0; i < num_positions_; i++) {
+      cc |= ColorComb(index % colors_.size()) << (4 * i);
+      index /= colors_.size();
+    }
+    return cc;
+  }
+  size_t num_codes() const;
+
+  // Returns the table of results of all pairs of combinations, or null if it
+  // would take more than memory_budget bytes.
+  std::shared_ptr<const ScoreTable> BuildScoreTable(size_t memory_budget) const;
+
+  // Look up results in the given table (which can be shared by several
+  // games with the same numbers of colors and positions) instead of
+  // computing them. Null switches back to computing them.
+  void set_score_table(std::shared_ptr<const ScoreTable> score_table);
+  const std::shared_ptr<const ScoreTable>& score_table() const {
+    return score_table_;
+  }
+
+  // The number of threads used by the Choose*Intent functions, by default
+  // the number of hardware threads. The chosen intent doesn't depend on it.
+  int num_threads() const { return num_threads_; }
+  void set_num_threads(int num_threads) { num_threads_ = num_threads; }
+
+  // Conversion between the packed representation and strings of colors.
+  // Only needed for input and output. string2cc needs a ValidIntent.
+  std::string cc2string(ColorComb cc) const;
+  ColorComb string2cc(const std::string& s) const;
+
+  // Whether input can be passed on: an intent of num_positions() colors
+  // of colors(), and an evaluation of at most num_positions() pegs.
+  bool ValidIntent(const std::string& intent) const;
+  bool ValidEvaluation(int black, int white) const;
+
+  // The color index at the given position
+  int Color(ColorComb cc, int position) const {
+    return (cc >> (4 * (num_positions_ - 1 - position))) & 0xF;
+  }
+
   // Colors in the same class are equivalent if they can be freely permuted
   // without changing the entropy if all known information arises from an
   // evaluation of the specified intent. This function returns the equivalence
@@ -115,66 +584,257 @@ class MasterMind {
   // Returns a unique representative of the passed intent
   // in such a way that intents are equivalent iff they have an equal
   // representative according to color equivalences in color_class_list_.
-  std::string IntentClass(const std::string& intent) const;
+  ColorComb IntentClass(ColorComb intent) const;
 
-  /*
   // Positions in the same class are equivalent if they can be freely permuted
-  // without changing the entropy if all known information arises from an
-  // evaluation of the specified intent.
-  void PositionClasses(const std::string& intent,
-                       std::vector<int>* classes) const;
-  */
+  // without changing the entropy, given all intents so far: they are the
+  // positions at which every intent has the same color. Sets (*classes)[i] to
+  // the first position in the class of position i.
+  void PositionClasses(std::vector<int>* classes) const;
   
   // for a given target (hidden combination), return the number of black/white
   // for the given intent    
-  static pair<int,int> Evaluate(
+  static std::pair<int,int> Evaluate(
       const std::string& target, const std::string& intent);
+  std::pair<int,int> Evaluate(ColorComb target, ColorComb intent) const;
+
+  ColorCounts CountColors(ColorComb cc) const {
+    ColorCounts counts = 0;
+    for (int i = 0; i < num_positions_; i++, cc >>= 4)
+      counts += ColorCounts(1) << (4 * (cc & 0xF));
+    return counts;
+  }
+
+  // The scoring kernel: Evaluate for combinations whose color counts have
+  // been computed beforehand. It doesn't branch or allocate, see ScoreKernel.
+  std::pair<int,int> Evaluate(ColorComb target, ColorCounts target_counts,
+                              ColorComb intent,
+                              ColorCounts intent_counts) const {
+    int common;
+    int black = ScoreKernel(target, target_counts, intent, intent_counts,
+                            position_bits_, num_positions_, &common);
+    return {black, common - black};
+  }
   
   // The events are the evaluations, 14 of them for four positions.
   // For a given intent, the space of targets is partitioned by the outcomes.
   // The entropy of that partition (event space) is returned, where all
   // targets are assumed to be equally likely.
-  double Entropy(const std::string& intent) const;
-  
+  double Entropy(ColorComb intent) const;
+
+  // The ratings of intent by all strategies, from a single count of its
+  // results.
+  IntentScores Scores(ColorComb intent) const;
+
   // For n colors, equivalence classes of starting positions correspond to
   // partitions of the number of positions in at most n summands.
-  // The best partition is returned.
+  // The best partition by strategy() is returned.
   std::vector<int> ChooseInitialIntent() const;
+
+  // The representative intent of a partition as returned by
+  // ChooseInitialIntent, e.g. 0012 for 2,1,1.
+  ColorComb InitialIntent(const std::vector<int>& partition) const;
   
-  // In the given state, return an intent of maximal entropy that actually is a
-  // possible candidate. Equivalences are used to speed this up.
-  std::string Choose2ndIntent() const;
+  // The same as ChooseIntent, which uses the color equivalences (and more)
+  // itself now.
+  ColorComb Choose2ndIntent() const { return ChooseIntent(); }
+
+  // The numbers of targets an intent search scored (counting the distinct
+  // color counts of targets for which the common colors are counted), and
+  // of the ones it didn't need to score because intents were abandoned.
+  struct SearchStats {
+    uint64_t scorings = 0;
+    uint64_t scorings_saved = 0;
+    // whether the intent was found in the decision cache instead
+    bool cached = false;
+    // The representatives the search had to decide on, and how many of
+    // them it rated or skipped by their bound before reaching its limits.
+    int intents = 0;
+    int intents_covered = 0;
+    // whether the intent is that of a search without limits
+    bool complete() const { return intents_covered == intents; }
+  };
+
+  // When a search should stop, e.g. for a hint that must be given in time:
+  // at the deadline, or once another thread sets *stop (like a
+  // std::stop_token). By default there are no limits.
+  struct SearchLimits {
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+    const std::atomic<bool>* stop = nullptr;
+  };
   
-  // In the given state, return an intent of maximal entropy that actually is a
-  // possible candidate
-  std::string ChooseIntent() const;
+  // In the given state, return an intent of maximal entropy (or of the best
+  // rating by strategy()) that actually is a possible candidate. Only one
+  // intent of every orbit of the symmetries that fix the intents so far is
+  // evaluated, the smallest one, so that the result is the same as when
+  // evaluating all of them.
+  // With bounded search and the entropy strategy, the intents are evaluated
+  // in decreasing order of an upper bound of their entropy that only
+  // depends on black + white, and abandoned as soon as they can't reach the
+  // best entropy so far, see BoundedEntropy. This doesn't change the result
+  // either.
+  // This greedy choice isn't necessarily optimal: the results of an intent
+  // of maximal entropy may have inferior follow up entropies to those of
+  // another one. Solver computes an optimal strategy.
+  // If inconsistent evaluations left no possible targets, it returns 0.
+  ColorComb ChooseIntent(SearchStats* stats = nullptr) const;
+
+  // ChooseIntent as an anytime search: once limits are reached, it rates
+  // no more intents and returns the best one rated so far, which is at
+  // least the first one. The representatives that are possible targets
+  // are rated first, so that it can still win right away, and then the
+  // others, both in canonical order, with the bounds computed as they are
+  // reached rather than all up front. stats tells how many were covered;
+  // only complete searches are stored in the decision cache. Without
+  // limits, this is ChooseIntent.
+  ColorComb ChooseIntent(const SearchLimits& limits,
+                         SearchStats* stats = nullptr) const;
+
+  // Sets (*intents)[k] to the intent ChooseIntent would return with
+  // strategies[k], but counts the results of every intent only once for
+  // all of them, e.g. to compare strategies. It doesn't use bounded search.
+  void ChooseIntents(const std::vector<Strategy>& strategies,
+                     std::vector<ColorComb>* intents) const;
+
+  // The limits of EstimateIntent, 0 meaning none: the wall time in
+  // seconds and the number of scorings (of an intent against a target).
+  struct SampleBudget {
+    double seconds = 0;
+    uint64_t scorings = 0;
+    // the size of the first sample of targets
+    size_t initial_sample = 64;
+    // of the random sample
+    uint64_t seed = 1;
+  };
+
+  // An approximation of ChooseIntent by entropy for many possible targets,
+  // which returns within budget. It estimates the entropy of every
+  // representative (see IntentRepresentatives) on a random sample of the
+  // targets, with a confidence interval, and races them: the intents whose
+  // interval lies below that of another one are dropped, and the sample is
+  // doubled for the others, until one is left, or the sample contains all
+  // targets, which gives exact entropies and usually the intent of
+  // ChooseIntent. When a round would exceed the budget, it only keeps the
+  // intents of the best estimates it allows (successive halving), and it
+  // stops when that is fewer than two. The first round is always
+  // completed, with a sample of at least 16 targets. Returns the intent
+  // of the best estimate, preferring possible targets among equal ones.
+  // It rates by entropy whatever the strategy, and doesn't use the
+  // decision cache. Like ChooseIntent, it returns 0 without possible
+  // targets.
+  ColorComb EstimateIntent(const SampleBudget& budget,
+                           SearchStats* stats = nullptr) const;
+
+  // ChooseIntent first looks for the possible targets in the given cache,
+  // and stores the intents it computes there. The cache can be shared by
+  // any number of games, e.g. copies of one game playing against different
+  // targets, also with different numbers of colors and positions or
+  // strategies. Null disables it.
+  void set_decision_cache(std::shared_ptr<DecisionCache> decision_cache) {
+    decision_cache_ = decision_cache;
+  }
+  const std::shared_ptr<DecisionCache>& decision_cache() const {
+    return decision_cache_;
+  }
+
+  Strategy strategy() const { return strategy_; }
+  void set_strategy(Strategy strategy) { strategy_ = strategy; }
+
+  bool bounded_search() const { return bounded_search_; }
+  void set_bounded_search(bool bounded_search) {
+    bounded_search_ = bounded_search;
+  }
+
+  // Whether Updates and ChooseIntent prune intents, see PruneStats.
+  // ChooseIntent only evaluates the remaining ones, which gives the same
+  // intent.
+  bool prune_intents() const { return prune_intents_; }
+  void set_prune_intents(bool prune_intents) { prune_intents_ = prune_intents; }
+  // The intents that Updates didn't prune
+  int num_intents() const { return num_intents_; }
+  // Of the last Update, and the searches after it
+  PruneStats last_prune_stats() const {
+    PruneStats stats;
+    if (!undo_stack_.empty()) {
+      stats = undo_stack_.back().prune_stats;
+      stats.duplicates = duplicates_.back().intents.size();
+    }
+    return stats;
+  }
+
+  // Sets *representatives to the index in intent_candidates_ of the
+  // smallest intent of every orbit of the symmetries that fix the intents
+  // so far, in increasing order, unless it has been pruned. All intents of
+  // an orbit partition the possible targets alike (up to the symmetry), so
+  // searches only need to consider these.
+  // The lazy engine gives the CodeIndex of the intents instead, and may
+  // give some more intents than the smallest ones, as it generates them
+  // without visiting all codes: the ones that no generator of the
+  // symmetries maps to a smaller intent.
+  void IntentRepresentatives(std::vector<int>* representatives) const;
+
+  // All 0 unless stats_enabled(). Like Update, this isn't thread safe: a
+  // game shouldn't be used on several threads at the same time, which
+  // ChooseIntent doesn't need anyway.
+  Stats stats() const { return stats_; }
+  void ResetStats() { stats_ = Stats(); }
+  // False if the library was compiled with -DMASTERMIND_STATS=0, which
+  // removes the counters and timers altogether. The layout of the class
+  // doesn't depend on it.
+  static bool stats_enabled();
+
+  bool use_symmetries() const { return use_symmetries_; }
+  void set_use_symmetries(bool use_symmetries) {
+    use_symmetries_ = use_symmetries;
+  }
 
   bool exist_equivalences() const {return color_class_list_.size() != colors_.size();}
 
   // Update the existing equivalence relation (the list of color classes) and
   // refine it by taking the information obtained from the new intent into
   // account, i.e. with the new intent, some colors will cease to be equivalent.
-  void UpdateEquivalences(const string& intent);
+  void UpdateEquivalences(const std::string& intent);
   
   // Updates the candidate lists assuming the passed intent resulted in the
   // specified numbers of black and white
   // Returns the information gained.
-  double Update(const std::string& intent, int black, int white);
+  // The candidates are filtered in place, so this doesn't allocate (except
+  // for saving the color classes while there are equivalences).
+  double Update(ColorComb intent, int black, int white);
+
+  // Reverts the last Update that hasn't been undone yet, e.g. to explore
+  // hypothetical turns without copying the game.
+  void Undo();
+  int num_updates() const { return undo_stack_.size(); }
   
-  auto target_candidates_begin() const { return target_candidates_.cbegin(); }
-  auto target_candidates_end() const { return target_candidates_.cend(); }
+  // Whether the possible targets are all codes, which the lazy engine
+  // doesn't store
+  bool implicit_targets() const { return lazy_ && undo_stack_.empty(); }
 
-  int num_candidates() const {
-    return target_candidates_end() - target_candidates_begin();
+  // The possible targets. With the lazy engine, this range is empty until
+  // the first Update, while all codes are possible (implicit_targets()), so
+  // code that needs the initial targets, like Solver, mastermind-sim and
+  // GameCache::Build, uses another engine.
+  auto target_candidates_begin() const { return target_candidates_.cbegin(); }
+  auto target_candidates_end() const {
+    return implicit_targets() ? target_candidates_.cend() :
+        target_candidates_.cbegin() + num_targets_;
   }
-  
+
+  int num_candidates() const { return num_targets_; }
+
+  // All codes, an empty range with the lazy engine.
   auto intent_candidates_begin() const { return intent_candidates_.cbegin(); }
   auto intent_candidates_end() const { return intent_candidates_.cend(); }
 
-  // Tests
-  static int test_to_from_string(const std::string& colors,
-                                 const std::string& colorcomb,
-                                 const std::string& colorstring);
+ private:
+  // ChooseIntent without the decision cache
+  ColorComb ComputeIntent(const SearchLimits& limits,
+                          SearchStats* stats) const;
+
+  // The unit tests check the internal state too
+  friend class MasterMindTest;
 };
 
 #endif // MASTERMIND_H_
@@ -0,0 +1,637 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "mastermind.h"
+
+// Friend of MasterMind, so that the tests can check its internal state
+class MasterMindTest : public ::testing::Test {
+ protected:
+  using ColorComb = MasterMind::ColorComb;
+
+  // The batch scoring functions supported by the cpu must count the results
+  // of an intent against targets like the scoring kernel.
+  static void CheckScoreBatch(const string& colors, int num_positions);
+  // Plays games against a number of targets, with and without a score
+  // table, checking that every Update leaves the targets consistent with
+  // the evaluation, and that undoing the Updates restores every state
+  // before.
+  static void CheckUndo(const string& colors, int num_positions);
+  // Plays a number of games, checking along them that the symmetry
+  // generators fix the intents so far and preserve entropies, and that
+  // ChooseIntent gives the same intent with and without them.
+  static void CheckSymmetries(const string& colors, int num_positions);
+
+  static const vector<string>& color_classes(const MasterMind& game) {
+    return game.color_class_list_;
+  }
+  static void UpdateEquivalences(MasterMind* game, const string& intent) {
+    game->UpdateEquivalences(intent);
+  }
+  static int NumResults(const MasterMind& game) { return game.NumResults(); }
+  static double EntropyOfCounts(const MasterMind& game,
+                                const vector<int>& counter) {
+    return game.EntropyOfCounts(counter.data());
+  }
+  // Checks that the entropy of results of random sizes, adding up to the
+  // possible targets, is close to that computed in floating point, and
+  // exactly the same for every order of the sizes
+  static void CheckEntropyOfCounts(const MasterMind& game);
+};
+
+namespace {
+
+const string kAllColors = "0123456789abcdef";
+
+// Plays a game against target, choosing the intents with chooser(), which
+// is called after every Update with the number of turns so far. Stops
+// when only the target is left.
+template <typename Chooser>
+void Play(MasterMind* game, MasterMind::ColorComb target, Chooser chooser) {
+  for (int turn = 0; game->num_candidates() > 1; turn++) {
+    MasterMind::ColorComb intent = chooser(turn);
+    auto bw = game->Evaluate(target, intent);
+    game->Update(intent, bw.first, bw.second);
+  }
+}
+
+}  // namespace
+
+void MasterMindTest::CheckScoreBatch(const string& colors,
+                                     int num_positions) {
+  vector<ScoreBatchFunction> functions = {ScoreBatchScalar};
+  ScoreBatchFunction best = BestScoreBatch();
+  if (best == ScoreBatchSse42 || best == ScoreBatchAvx2)
+    functions.push_back(ScoreBatchSse42);
+  if (best == ScoreBatchAvx2)
+    functions.push_back(ScoreBatchAvx2);
+  MasterMind game(colors, num_positions);
+  vector<ColorComb> targets(game.target_candidates_begin(),
+                            game.target_candidates_end());
+  targets.resize(min<size_t>(targets.size(), 4099));
+  vector<MasterMind::ColorCounts> counts;
+  for (auto target: targets)
+    counts.push_back(game.CountColors(target));
+  for (auto intent = game.intent_candidates_begin();
+       intent != game.intent_candidates_end() &&
+           intent - game.intent_candidates_begin() < 500; ++intent) {
+    vector<int> expected(game.NumResults(), 0);
+    for (auto target: targets)
+      expected[game.EvaluationNumerical_(target, *intent)]++;
+    for (auto function: functions) {
+      vector<int> counter(game.NumResults(), 0);
+      function(targets.data(), counts.data(), targets.size(), *intent,
+               game.CountColors(*intent), game.num_positions(),
+               game.result_index_, counter.data());
+      EXPECT_EQ(expected, counter) << ScoreBatchName(function) << " for "
+                                   << game.cc2string(*intent);
+    }
+  }
+}
+
+void MasterMindTest::CheckUndo(const string& colors, int num_positions) {
+  MasterMind initial(colors, num_positions);
+  size_t n = initial.num_candidates();
+  for (int with_table = 0; with_table < 2; with_table++) {
+    MasterMind game(initial);
+    if (with_table)
+      game.set_score_table(game.BuildScoreTable(64 << 20));
+    for (size_t k = 0; k < 20; k++) {
+      ColorComb target = game.intent_candidates_[k * 7919 % n];
+      vector<vector<ColorComb>> states;
+      vector<vector<string>> class_lists;
+      for (size_t turn = 1; game.num_candidates() > 1; turn++) {
+        ColorComb intent = game.intent_candidates_[(k + turn) * 104729 % n];
+        int black, white;
+        tie(black, white) = game.Evaluate(target, intent);
+        states.emplace_back(game.target_candidates_begin(),
+                            game.target_candidates_end());
+        class_lists.push_back(game.color_class_list_);
+        game.Update(intent, black, white);
+        vector<ColorComb> expected;
+        for (auto t: states.back())
+          if (game.Evaluate(t, intent) == make_pair(black, white))
+            expected.push_back(t);
+        EXPECT_TRUE(equal(expected.begin(), expected.end(),
+                          game.target_candidates_begin(),
+                          game.target_candidates_end()));
+      }
+      while (game.num_updates() > 0) {
+        game.Undo();
+        ASSERT_TRUE(equal(states.back().begin(), states.back().end(),
+                          game.target_candidates_begin(),
+                          game.target_candidates_end()))
+            << "target " << game.cc2string(target);
+        EXPECT_EQ(class_lists.back(), game.color_class_list_);
+        for (size_t i = 0; i < game.num_targets_; i++) {
+          EXPECT_EQ(game.CountColors(game.target_candidates_[i]),
+                    game.target_counts_[i]);
+          if (game.score_table_) {
+            EXPECT_EQ(game.CodeIndex(game.target_candidates_[i]),
+                      game.target_indices_[i]);
+          }
+        }
+        states.pop_back();
+        class_lists.pop_back();
+      }
+    }
+  }
+}
+
+void MasterMindTest::CheckSymmetries(const string& colors,
+                                     int num_positions) {
+  MasterMind initial(colors, num_positions);
+  size_t n = initial.num_candidates();
+  for (size_t k = 0; k < 10; k++) {
+    MasterMind game(initial);
+    ColorComb target = game.intent_candidates_[k * 7919 % n];
+    Play(&game, target, [&](int) {
+        vector<MasterMind::Symmetry> generators;
+        game.SymmetryGenerators(&generators);
+        for (auto& generator: generators) {
+          for (auto intent: game.intents_)
+            EXPECT_EQ(intent, game.Apply(generator, intent));
+          for (size_t i = 0; i < n; i += 1 + n / 100) {
+            ColorComb intent = game.intent_candidates_[i];
+            EXPECT_EQ(game.Entropy(intent),
+                      game.Entropy(game.Apply(generator, intent)));
+          }
+        }
+        ColorComb intent = game.ChooseIntent();
+        game.set_use_symmetries(false);
+        EXPECT_EQ(intent, game.ChooseIntent());
+        game.set_use_symmetries(true);
+        return intent;
+      });
+  }
+}
+
+TEST_F(MasterMindTest, StringConversion) {
+  MasterMind game("rgbyop", 4);
+  EXPECT_EQ("rgby", game.cc2string(game.string2cc("rgby")));
+  EXPECT_EQ(0x0123u, game.string2cc("rgby"));
+  for (auto cc = game.target_candidates_begin();
+       cc != game.target_candidates_end(); ++cc)
+    EXPECT_EQ(*cc, game.string2cc(game.cc2string(*cc)));
+}
+
+TEST_F(MasterMindTest, Valid) {
+  EXPECT_TRUE(MasterMind::Valid("rgbyop", 4));
+  EXPECT_TRUE(MasterMind::Valid(kAllColors, MasterMind::kMaxPositions));
+  EXPECT_FALSE(MasterMind::Valid("01", MasterMind::kMaxPositions + 1));
+  EXPECT_FALSE(MasterMind::Valid(kAllColors + "g", 2));
+  EXPECT_FALSE(MasterMind::Valid("rgbyop", 0));
+  EXPECT_FALSE(MasterMind::Valid("rgbyop", -1));
+  EXPECT_FALSE(MasterMind::Valid("", 4));
+  EXPECT_FALSE(MasterMind::Valid("rrgb", 4));
+  EXPECT_THROW(MasterMind("01", 16), invalid_argument);
+}
+
+TEST_F(MasterMindTest, ValidInput) {
+  MasterMind game("rgbyop", 4);
+  EXPECT_TRUE(game.ValidIntent("rgby"));
+  EXPECT_FALSE(game.ValidIntent("rgb"));
+  EXPECT_FALSE(game.ValidIntent("rgbyo"));
+  EXPECT_FALSE(game.ValidIntent("rgbx"));
+  EXPECT_TRUE(game.ValidEvaluation(0, 4));
+  EXPECT_FALSE(game.ValidEvaluation(3, 2));
+  EXPECT_FALSE(game.ValidEvaluation(-1, 0));
+}
+
+TEST_F(MasterMindTest, Evaluate) {
+  EXPECT_EQ(make_pair(4, 0), MasterMind::Evaluate("rgby", "rgby"));
+  EXPECT_EQ(make_pair(0, 4), MasterMind::Evaluate("rgby", "yrgb"));
+  EXPECT_EQ(make_pair(1, 1), MasterMind::Evaluate("rrgg", "rbbr"));
+  EXPECT_EQ(make_pair(0, 0), MasterMind::Evaluate("rrrr", "gggg"));
+}
+
+// The scoring kernel must agree with the string based Evaluate for all
+// pairs of combinations
+TEST_F(MasterMindTest, EvaluateKernel) {
+  for (auto configuration: vector<pair<int, int>>{
+           {1, 1}, {2, 3}, {3, 4}, {4, 4}, {6, 4}, {4, 5}, {3, 7}, {16, 2},
+           {2, 10}}) {
+    MasterMind game(kAllColors.substr(0, configuration.first),
+                    configuration.second);
+    for (auto t = game.target_candidates_begin();
+         t != game.target_candidates_end(); ++t) {
+      string target = game.cc2string(*t);
+      for (auto i = game.intent_candidates_begin();
+           i != game.intent_candidates_end(); ++i)
+        ASSERT_EQ(MasterMind::Evaluate(target, game.cc2string(*i)),
+                  game.Evaluate(*t, *i))
+            << target << " with " << game.cc2string(*i);
+    }
+  }
+}
+
+TEST_F(MasterMindTest, ScoreBatch) {
+  for (auto configuration: vector<pair<int, int>>{
+           {1, 1}, {3, 4}, {6, 4}, {8, 5}, {16, 2}, {2, 15}})
+    CheckScoreBatch(kAllColors.substr(0, configuration.first),
+                    configuration.second);
+}
+
+// The entropy is that of the sizes of the parts of the targets with the
+// same evaluation
+TEST_F(MasterMindTest, Entropy) {
+  MasterMind game("rgbyop", 4);
+  for (string intent: {"rrrr", "rrgg", "rrgb", "rgby"}) {
+    ColorComb cc = game.string2cc(intent);
+    map<pair<int, int>, int> parts;
+    for (auto t = game.target_candidates_begin();
+         t != game.target_candidates_end(); ++t)
+      parts[game.Evaluate(*t, cc)]++;
+    double entropy = 0;
+    for (auto& part: parts) {
+      double p = double(part.second) / game.num_candidates();
+      entropy -= p * log2(p);
+    }
+    EXPECT_NEAR(entropy, game.Entropy(cc), 1e-9) << intent;
+  }
+}
+
+void MasterMindTest::CheckEntropyOfCounts(const MasterMind& game) {
+  mt19937 random(game.num_positions());
+  size_t n = game.num_candidates();
+  for (int k = 0; k < 10; k++) {
+    vector<int> counter(NumResults(game), 0);
+    size_t left = n;
+    for (size_t i = 0; i + 1 < counter.size() && left > 0; i++) {
+      counter[i] = random() % (left / 4 + 1);
+      left -= counter[i];
+    }
+    counter.back() += left;
+    double expected = 0;
+    for (auto c: counter) {
+      double p = double(c) / n;
+      expected -= c > 0 ? p * log2(p) : 0;
+    }
+    double entropy = EntropyOfCounts(game, counter);
+    EXPECT_NEAR(expected, entropy, 1e-12);
+    for (int shuffles = 0; shuffles < 10; shuffles++) {
+      shuffle(counter.begin(), counter.end(), random);
+      EXPECT_EQ(entropy, EntropyOfCounts(game, counter));
+    }
+  }
+}
+
+TEST_F(MasterMindTest, EntropyOfCounts) {
+  CheckEntropyOfCounts(MasterMind("rgbyop", 4));
+  // with fewer fraction bits
+  CheckEntropyOfCounts(MasterMind(kAllColors.substr(0, 10), 8,
+                                  MasterMind::Engine::kLazy));
+}
+
+TEST_F(MasterMindTest, Update) {
+  MasterMind game("rgbyop", 4);
+  EXPECT_EQ(1296, game.num_candidates());
+  double information = game.Update(game.string2cc("rgby"), 1, 1);
+  EXPECT_EQ(252, game.num_candidates());
+  EXPECT_NEAR(log2(1296.0 / 252), information, 1e-9);
+  for (auto t = game.target_candidates_begin();
+       t != game.target_candidates_end(); ++t)
+    EXPECT_EQ(make_pair(1, 1), game.Evaluate(*t, game.string2cc("rgby")));
+}
+
+TEST_F(MasterMindTest, ColorClasses) {
+  MasterMind game("rgbyop", 4);
+  vector<string> classes;
+  game.ColorClasses("rrgb", &classes);
+  EXPECT_EQ((vector<string>{"yop", "gb", "r"}), classes);
+  UpdateEquivalences(&game, "rrgb");
+  EXPECT_EQ((vector<string>{"yop", "gb", "r"}), color_classes(game));
+  // the representative takes the first colors of every class
+  EXPECT_EQ("yyog", game.cc2string(game.IntentClass(game.string2cc("ppyb"))));
+}
+
+TEST_F(MasterMindTest, ChooseInitialIntent) {
+  MasterMind game("rgbyop", 4);
+  EXPECT_EQ((vector<int>{1, 1, 1, 1}), game.ChooseInitialIntent());
+  // Knuth's first intent
+  game.set_strategy(MasterMind::Strategy::kMinimax);
+  EXPECT_EQ((vector<int>{2, 2}), game.ChooseInitialIntent());
+}
+
+TEST_F(MasterMindTest, Undo) {
+  CheckUndo("rgbyop", 4);
+  CheckUndo("rgbyopcm", 4);
+}
+
+TEST_F(MasterMindTest, Symmetries) {
+  CheckSymmetries("rgbyop", 4);
+  CheckSymmetries("rgbyopcm", 4);
+}
+
+// ChooseIntent must give the same intents with and without pruning
+// intents, and undoing the game must restore them. Only ChooseIntent
+// skips duplicates, without changing the intents left.
+TEST_F(MasterMindTest, PruneIntents) {
+  int duplicates = 0;
+  for (string target: {"oopy", "rgby", "ppcm"}) {
+    MasterMind pruned("rgbyopcm", 4);
+    MasterMind unpruned("rgbyopcm", 4);
+    unpruned.set_prune_intents(false);
+    MasterMind::ColorComb secret = pruned.string2cc(target);
+    while (pruned.num_candidates() > 1) {
+      int num_intents = pruned.num_intents();
+      MasterMind::ColorComb intent = pruned.ChooseIntent();
+      EXPECT_EQ(intent, unpruned.ChooseIntent());
+      EXPECT_EQ(num_intents, pruned.num_intents());
+      duplicates += pruned.last_prune_stats().duplicates;
+      auto bw = pruned.Evaluate(secret, intent);
+      pruned.Update(intent, bw.first, bw.second);
+      unpruned.Update(intent, bw.first, bw.second);
+      EXPECT_EQ(0, pruned.last_prune_stats().duplicates);
+    }
+    EXPECT_LT(pruned.num_intents(), unpruned.num_intents());
+    while (pruned.num_updates() > 0)
+      pruned.Undo();
+    EXPECT_EQ(unpruned.num_intents(), pruned.num_intents());
+  }
+  EXPECT_GT(duplicates, 0);
+}
+
+// The bitset engine must give the same entropies for all intents and the
+// same targets as the vector engine, along a game and after undoing it.
+TEST_F(MasterMindTest, Engines) {
+  MasterMind vectors("rgbyop", 4);
+  MasterMind bitsets("rgbyop", 4, MasterMind::Engine::kBitsets);
+  ASSERT_EQ(MasterMind::Engine::kBitsets, bitsets.engine());
+  auto compare = [&]() {
+    EXPECT_TRUE(equal(vectors.target_candidates_begin(),
+                      vectors.target_candidates_end(),
+                      bitsets.target_candidates_begin(),
+                      bitsets.target_candidates_end()));
+    for (auto intent = vectors.intent_candidates_begin();
+         intent != vectors.intent_candidates_end(); ++intent)
+      EXPECT_EQ(vectors.Entropy(*intent), bitsets.Entropy(*intent))
+          << vectors.cc2string(*intent);
+  };
+  compare();
+  MasterMind::ColorComb target = vectors.string2cc("poyo");
+  while (vectors.num_candidates() > 1) {
+    MasterMind::ColorComb intent = vectors.ChooseIntent();
+    auto bw = vectors.Evaluate(target, intent);
+    vectors.Update(intent, bw.first, bw.second);
+    bitsets.Update(intent, bw.first, bw.second);
+    compare();
+  }
+  while (bitsets.num_updates() > 0) {
+    vectors.Undo();
+    bitsets.Undo();
+    compare();
+  }
+}
+
+// The lazy engine must give the same targets, entropies and intents as
+// the vector engine, with and without a score table, along games and after
+// undoing them, and its representatives must include those of the vector
+// engine.
+TEST_F(MasterMindTest, Lazy) {
+  MasterMind huge(kAllColors.substr(0, 10), 8, MasterMind::Engine::kLazy);
+  EXPECT_EQ(100000000, huge.num_candidates());
+  EXPECT_EQ(huge.target_candidates_begin(), huge.target_candidates_end());
+  EXPECT_EQ(12345678u, huge.CodeIndex(huge.CodeAt(12345678)));
+
+  MasterMind vectors("rgbyopcm", 4);
+  vectors.set_prune_intents(false);
+  MasterMind lazy("rgbyopcm", 4, MasterMind::Engine::kLazy);
+  ASSERT_EQ(MasterMind::Engine::kLazy, lazy.engine());
+  MasterMind table(lazy);
+  table.set_score_table(table.BuildScoreTable(64 << 20));
+  EXPECT_EQ(vectors.ChooseInitialIntent(), lazy.ChooseInitialIntent());
+  auto compare = [&]() {
+    ASSERT_EQ(vectors.num_candidates(), lazy.num_candidates());
+    if (lazy.num_updates() > 0) {
+      EXPECT_TRUE(equal(vectors.target_candidates_begin(),
+                        vectors.target_candidates_end(),
+                        lazy.target_candidates_begin(),
+                        lazy.target_candidates_end()));
+    }
+    for (int i = 0; i < 4096; i += 37) {
+      ColorComb intent = lazy.CodeAt(i);
+      EXPECT_EQ(vectors.Entropy(intent), lazy.Entropy(intent));
+      EXPECT_EQ(vectors.Entropy(intent), table.Entropy(intent));
+    }
+    vector<int> representatives, lazy_representatives;
+    vectors.IntentRepresentatives(&representatives);
+    lazy.IntentRepresentatives(&lazy_representatives);
+    EXPECT_TRUE(includes(lazy_representatives.begin(),
+                         lazy_representatives.end(),
+                         representatives.begin(), representatives.end()));
+  };
+  for (string target: {"poyo", "cmrg"}) {
+    MasterMind::ColorComb secret = vectors.string2cc(target);
+    compare();
+    while (vectors.num_candidates() > 1) {
+      MasterMind::ColorComb intent = vectors.ChooseIntent();
+      EXPECT_EQ(intent, lazy.ChooseIntent());
+      EXPECT_EQ(intent, table.ChooseIntent());
+      auto bw = vectors.Evaluate(secret, intent);
+      vectors.Update(intent, bw.first, bw.second);
+      lazy.Update(intent, bw.first, bw.second);
+      table.Update(intent, bw.first, bw.second);
+      compare();
+    }
+    while (lazy.num_updates() > 0) {
+      vectors.Undo();
+      lazy.Undo();
+      table.Undo();
+      compare();
+    }
+    EXPECT_EQ(lazy.target_candidates_begin(), lazy.target_candidates_end());
+  }
+}
+
+// Without a budget, EstimateIntent must nearly always find an intent of
+// maximal entropy, and otherwise one close to it, and it must keep to a
+// budget of scorings after the first round.
+TEST_F(MasterMindTest, EstimateIntent) {
+  MasterMind game("rgbyopcm", 4);
+  MasterMind::SampleBudget unlimited;
+  MasterMind::SampleBudget budget;
+  budget.scorings = 20000;
+  int num_choices = 0, num_optimal = 0;
+  for (string target: {"poyo", "cmrg", "bbbb", "rgyc", "mmpo"}) {
+    MasterMind::ColorComb secret = game.string2cc(target);
+    MasterMind::ColorComb intent = game.InitialIntent(
+        game.ChooseInitialIntent());
+    while (intent != secret) {
+      auto bw = game.Evaluate(secret, intent);
+      game.Update(intent, bw.first, bw.second);
+      if (game.num_candidates() == 1) {
+        intent = *game.target_candidates_begin();
+        continue;
+      }
+      intent = game.ChooseIntent();
+      double best = game.Entropy(intent);
+      double estimated = game.Entropy(game.EstimateIntent(unlimited));
+      EXPECT_GT(estimated, best - 0.1);
+      num_choices++;
+      num_optimal += estimated > best - 1e-9;
+      // except for the first round
+      vector<int> representatives;
+      game.IntentRepresentatives(&representatives);
+      MasterMind::SearchStats stats;
+      game.EstimateIntent(budget, &stats);
+      EXPECT_LE(stats.scorings, max<uint64_t>(budget.scorings,
+                                              16 * representatives.size()));
+    }
+    while (game.num_updates() > 0)
+      game.Undo();
+  }
+  EXPECT_GE(num_optimal, num_choices * 9 / 10) << num_choices;
+}
+
+// Inconsistent evaluations leave no possible targets, and no intent to
+// choose
+TEST_F(MasterMindTest, NoTargets) {
+  MasterMind game("rgbyop", 4);
+  game.Update(game.string2cc("rgby"), 1, 1);
+  game.Update(game.string2cc("rrrr"), 4, 0);
+  ASSERT_EQ(0, game.num_candidates());
+  EXPECT_EQ(0u, game.ChooseIntent());
+  MasterMind::SampleBudget unlimited;
+  EXPECT_EQ(0u, game.EstimateIntent(unlimited));
+}
+
+// Without limits, the anytime search must be ChooseIntent. Stopped right
+// away, it must still rate an intent, a possible target, and not store it
+// in the decision cache.
+TEST_F(MasterMindTest, AnytimeIntent) {
+  MasterMind game("rgbyopcm", 4);
+  game.set_num_threads(1);
+  MasterMind::SearchLimits unlimited, past, stopped;
+  past.deadline = chrono::steady_clock::now();
+  atomic<bool> stop(true);
+  stopped.stop = &stop;
+  for (auto intent: {"rrgb", "ypoo"}) {
+    auto bw = game.Evaluate(game.string2cc("cmry"), game.string2cc(intent));
+    game.Update(game.string2cc(intent), bw.first, bw.second);
+  }
+  MasterMind::SearchStats stats;
+  EXPECT_EQ(game.ChooseIntent(), game.ChooseIntent(unlimited, &stats));
+  EXPECT_TRUE(stats.complete());
+  EXPECT_GT(stats.intents, 1);
+  for (auto limits: {past, stopped}) {
+    game.set_decision_cache(make_shared<DecisionCache>(16));
+    MasterMind::ColorComb intent = game.ChooseIntent(limits, &stats);
+    EXPECT_TRUE(binary_search(game.target_candidates_begin(),
+                              game.target_candidates_end(), intent));
+    EXPECT_EQ(1, stats.intents_covered);
+    EXPECT_FALSE(stats.complete());
+    EXPECT_EQ(0u, game.decision_cache()->size());
+  }
+
+  MasterMind lazy("rgbyopcm", 4, MasterMind::Engine::kLazy);
+  lazy.ChooseIntent(past, &stats);
+  EXPECT_EQ(min(8, stats.intents), stats.intents_covered);
+}
+
+// Bounded search, any number of threads and a score table must not change
+// the intents chosen
+TEST_F(MasterMindTest, SearchesAgree) {
+  MasterMind game("rgbyopcm", 4);
+  game.set_num_threads(1);
+  game.set_bounded_search(false);
+  MasterMind bounded(game), threads(game), table(game);
+  bounded.set_bounded_search(true);
+  threads.set_bounded_search(true);
+  threads.set_num_threads(4);
+  table.set_score_table(table.BuildScoreTable(64 << 20));
+  vector<MasterMind*> games = {&bounded, &threads, &table};
+  Play(&game, game.string2cc("cmry"), [&](int turn) {
+      MasterMind::ColorComb intent = turn == 0 ?
+          game.InitialIntent(game.ChooseInitialIntent()) : game.ChooseIntent();
+      for (MasterMind* other: games) {
+        if (turn > 0) {
+          EXPECT_EQ(game.cc2string(intent),
+                    other->cc2string(other->ChooseIntent()));
+        }
+        EXPECT_EQ(game.Entropy(intent), other->Entropy(intent));
+      }
+      auto bw = game.Evaluate(game.string2cc("cmry"), intent);
+      for (MasterMind* other: games)
+        other->Update(intent, bw.first, bw.second);
+      return intent;
+    });
+}
+
+// In the state after every evaluation of the initial intent, ChooseIntents
+// must agree with ChooseIntent for every strategy
+TEST_F(MasterMindTest, Strategies) {
+  MasterMind game("rgbyop", 4);
+  vector<MasterMind::Strategy> strategies;
+  for (int k = 0; k < MasterMind::kNumStrategies; k++) {
+    strategies.push_back(MasterMind::Strategy(k));
+    MasterMind::Strategy parsed;
+    ASSERT_TRUE(MasterMind::ParseStrategy(
+        MasterMind::StrategyName(strategies[k]), &parsed));
+    EXPECT_EQ(strategies[k], parsed);
+  }
+  MasterMind::ColorComb intent =
+      game.InitialIntent(game.ChooseInitialIntent());
+  for (int black = 0; black < game.num_positions(); black++) {
+    for (int white = 0; black + white <= game.num_positions(); white++) {
+      game.Update(intent, black, white);
+      if (game.num_candidates() > 0) {
+        vector<MasterMind::ColorComb> intents;
+        game.ChooseIntents(strategies, &intents);
+        for (int k = 0; k < MasterMind::kNumStrategies; k++) {
+          game.set_strategy(strategies[k]);
+          EXPECT_EQ(game.cc2string(intents[k]),
+                    game.cc2string(game.ChooseIntent()))
+              << black << " " << white << " "
+              << MasterMind::StrategyName(strategies[k]);
+        }
+        game.set_strategy(MasterMind::Strategy::kEntropy);
+      }
+      game.Undo();
+    }
+  }
+}
+
+TEST_F(MasterMindTest, Stats) {
+  MasterMind game("rgbyop", 4);
+  MasterMind::ColorComb target = game.string2cc("oopy");
+  Play(&game, target, [&](int turn) {
+      if (turn == 0)
+        return game.InitialIntent(game.ChooseInitialIntent());
+      MasterMind::Stats before = game.stats();
+      game.ResetStats();
+      MasterMind::ColorComb intent = game.ChooseIntent();
+      if (MasterMind::stats_enabled()) {
+        EXPECT_EQ(1u, before.updates);
+        // the targets scored by the Update
+        EXPECT_GE(before.evaluations, before.targets_before);
+        EXPECT_EQ(1u, game.stats().choices);
+        EXPECT_GT(game.stats().evaluations, 0u);
+        EXPECT_GT(game.stats().intents_rated, 0u);
+        EXPECT_FALSE(game.stats().Report().empty());
+      }
+      game.ResetStats();
+      return intent;
+    });
+  MasterMind::Stats stats = game.stats();
+  if (MasterMind::stats_enabled()) {
+    EXPECT_EQ(1u, stats.updates);
+    EXPECT_EQ(1u, stats.targets_after);
+  } else {
+    EXPECT_EQ(0u, stats.updates);
+  }
+}
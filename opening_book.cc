@@ -0,0 +1,181 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+using namespace std;
+
+#include "opening_book.h"
+
+// std::min takes it by reference
+const int OpeningBook::kMaxDepth;
+
+namespace {
+
+// A permutation of colors and positions: the combination cc is mapped to
+// the one with color color_map[cc[positions[i]]] at position i.
+struct Permutation {
+  vector<int> positions;
+  vector<int> color_map;
+
+  MasterMind::ColorComb Apply(const MasterMind& game,
+                              MasterMind::ColorComb cc) const {
+    MasterMind::ColorComb result = 0;
+    for (auto position: positions)
+      result = (result << 4) | color_map[game.Color(cc, position)];
+    return result;
+  }
+
+  MasterMind::ColorComb Invert(const MasterMind& game,
+                               MasterMind::ColorComb cc) const {
+    vector<int> inverse(color_map.size());
+    for (size_t c = 0; c < color_map.size(); c++)
+      inverse[color_map[c]] = c;
+    vector<int> colors(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+      colors[positions[i]] = inverse[game.Color(cc, i)];
+    MasterMind::ColorComb result = 0;
+    for (auto color: colors)
+      result = (result << 4) | color;
+    return result;
+  }
+};
+
+// The permutation mapping intent to its canonical form: colors are renamed
+// 0, 1, ... in order of decreasing multiplicity (and then of first
+// appearance), followed by the unused colors in their order, and the
+// positions are sorted by their new colors, e.g. rgrb becomes 0012.
+Permutation canonicalize(const MasterMind& game, MasterMind::ColorComb intent) {
+  int num_positions = game.num_positions();
+  int num_colors = game.colors().size();
+  vector<int> count(num_colors, 0), first(num_colors, num_positions);
+  for (int i = num_positions - 1; i >= 0; i--) {
+    count[game.Color(intent, i)]++;
+    first[game.Color(intent, i)] = i;
+  }
+  vector<int> order(num_colors);
+  for (int c = 0; c < num_colors; c++)
+    order[c] = c;
+  stable_sort(order.begin(), order.end(), [&](int c1, int c2) {
+      return count[c1] != count[c2] ? count[c1] > count[c2] :
+          first[c1] < first[c2];
+    });
+  Permutation permutation;
+  permutation.color_map.resize(num_colors);
+  for (int rank = 0; rank < num_colors; rank++)
+    permutation.color_map[order[rank]] = rank;
+
+  permutation.positions.resize(num_positions);
+  for (int i = 0; i < num_positions; i++)
+    permutation.positions[i] = i;
+  stable_sort(permutation.positions.begin(), permutation.positions.end(),
+              [&](int p1, int p2) {
+      return permutation.color_map[game.Color(intent, p1)] <
+          permutation.color_map[game.Color(intent, p2)];
+    });
+  return permutation;
+}
+
+uint64_t hashKey(uint64_t key) {
+  return key * 0x9E3779B97F4A7C15;
+}
+
+}  // namespace
+
+shared_ptr<const OpeningBook> OpeningBook::Build(const MasterMind& game,
+                                                 int depth) {
+  depth = min(depth, kMaxDepth);
+  int num_positions = game.num_positions();
+  vector<int> partition = game.ChooseInitialIntent();
+  MasterMind::ColorComb initial_intent = game.InitialIntent(partition);
+
+  // Play all evaluations of intent in state, depth first, undoing every
+  // Update instead of copying the state
+  vector<Entry> entries;
+  MasterMind state(game);
+  auto expand = [&](uint64_t key, MasterMind::ColorComb intent, int level,
+                    auto& expand) {
+    if (level > depth)
+      return;
+    for (int black = 0; black < num_positions; black++) {
+      for (int white = 0; black + white <= num_positions; white++) {
+        state.Update(intent, black, white);
+        if (state.num_candidates() > 0) {
+          MasterMind::ColorComb reply = state.num_candidates() == 1 ?
+              *state.target_candidates_begin() : state.ChooseIntent();
+          uint64_t next_key = Key(key, black, white);
+          entries.push_back({next_key, reply});
+          if (state.num_candidates() > 1)
+            expand(next_key, reply, level + 1, expand);
+        }
+        state.Undo();
+      }
+    }
+  };
+  expand(0, initial_intent, 1, expand);
+
+  // Open addressing with linear probing, at most half full
+  size_t num_slots = 1;
+  while (num_slots < 2 * entries.size())
+    num_slots *= 2;
+  auto book = make_shared<OpeningBook>(initial_intent, nullptr, num_slots);
+  book->storage_.assign(num_slots, Entry{0, 0});
+  for (auto& entry: entries) {
+    size_t slot = hashKey(entry.key) & (num_slots - 1);
+    while (book->storage_[slot].key != 0)
+      slot = (slot + 1) & (num_slots - 1);
+    book->storage_[slot] = entry;
+  }
+  book->slots_ = book->storage_.data();
+  return book;
+}
+
+const OpeningBook::Entry* OpeningBook::Find(uint64_t key) const {
+  if (num_slots_ == 0)
+    return nullptr;
+  for (size_t slot = hashKey(key) & (num_slots_ - 1); slots_[slot].key != 0;
+       slot = (slot + 1) & (num_slots_ - 1)) {
+    if (slots_[slot].key == key)
+      return &slots_[slot];
+  }
+  return nullptr;
+}
+
+vector<int> OpeningBook::initial_partition(int num_positions) const {
+  // the initial intent is 0..01..1.. so the partition are the lengths of runs
+  vector<int> partition;
+  int last_color = -1;
+  for (int i = num_positions - 1; i >= 0; i--) {
+    int color = (initial_intent_ >> (4 * i)) & 0xF;
+    if (color != last_color)
+      partition.push_back(0);
+    partition.back()++;
+    last_color = color;
+  }
+  return partition;
+}
+
+bool OpeningBook::Reply(const MasterMind& game,
+                        const vector<MasterMind::ColorComb>& intents,
+                        const vector<pair<int, int>>& evaluations,
+                        MasterMind::ColorComb* reply) const {
+  if (intents.empty() || intents.size() > kMaxDepth ||
+      evaluations.size() != intents.size())
+    return false;
+  Permutation permutation = canonicalize(game, intents[0]);
+  if (permutation.Apply(game, intents[0]) != initial_intent_)
+    return false;
+  uint64_t key = 0;
+  for (size_t turn = 0; turn < intents.size(); turn++) {
+    // later intents must be the book's replies
+    if (turn > 0) {
+      const Entry* entry = Find(key);
+      if (!entry || permutation.Apply(game, intents[turn]) != entry->intent)
+        return false;
+    }
+    key = Key(key, evaluations[turn].first, evaluations[turn].second);
+  }
+  const Entry* entry = Find(key);
+  if (!entry)
+    return false;
+  *reply = permutation.Invert(game, entry->intent);
+  return true;
+}
@@ -0,0 +1,73 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef OPENING_BOOK_H_
+#define OPENING_BOOK_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mastermind.h"
+
+// The recommended intents for the first turns of a game, so that hints for
+// them are lookups. The book starts with the intent of ChooseInitialIntent,
+// and contains the reply to each of its evaluations, the replies to the
+// evaluations of those, etc. up to some depth.
+//
+// Everything is stored in canonical coordinates: the first intent of a game
+// is mapped to its canonical form by renaming colors in order of decreasing
+// multiplicity and sorting positions (e.g. rgrb to 0012), and the same
+// permutation of colors and positions is applied to the later intents. As
+// this permutation maps the possible targets of the game to those of the
+// book, the book's replies mapped back are as good as the ones that would
+// be computed. Games that follow the book's hints stay in the book.
+class OpeningBook {
+ public:
+  // A slot of the hash table, the key encodes the evaluations so far, and is
+  // 0 for an empty slot.
+  struct Entry {
+    uint64_t key;
+    MasterMind::ColorComb intent;
+  };
+
+  // Computes the book for the game, which should be in its initial state.
+  // depth is the number of replies deep, at most 3.
+  static std::shared_ptr<const OpeningBook> Build(const MasterMind& game,
+                                                  int depth);
+
+  // A book in num_slots slots at slots, e.g. in a memory mapped file, which
+  // must outlive it.
+  OpeningBook(MasterMind::ColorComb initial_intent, const Entry* slots,
+              size_t num_slots)
+      : initial_intent_(initial_intent), slots_(slots), num_slots_(num_slots) {}
+
+  MasterMind::ColorComb initial_intent() const { return initial_intent_; }
+  const Entry* slots() const { return slots_; }
+  size_t num_slots() const { return num_slots_; }
+
+  // The partition of ChooseInitialIntent corresponding to initial_intent()
+  std::vector<int> initial_partition(int num_positions) const;
+
+  // Given the intents of a game so far and their evaluations, sets *reply to
+  // the recommended next intent and returns true, or returns false if the
+  // history isn't in the book.
+  bool Reply(const MasterMind& game,
+             const std::vector<MasterMind::ColorComb>& intents,
+             const std::vector<std::pair<int, int>>& evaluations,
+             MasterMind::ColorComb* reply) const;
+
+ private:
+  static const int kMaxDepth = 3;
+
+  static uint64_t Key(uint64_t key, int black, int white) {
+    return (key << 16) | (1 + 16 * black + white);
+  }
+  const Entry* Find(uint64_t key) const;
+
+  MasterMind::ColorComb initial_intent_;
+  const Entry* slots_;
+  size_t num_slots_;
+  // the slots, if the book owns them
+  std::vector<Entry> storage_;
+};
+
+#endif // OPENING_BOOK_H_
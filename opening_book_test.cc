@@ -0,0 +1,59 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <cmath>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "mastermind.h"
+#include "opening_book.h"
+
+namespace {
+
+// Plays a game against every target, with the first intent of the book
+// permuted by a rotation of colors and positions, following the book's
+// hints and checking that they are as good as the ones ChooseIntent
+// computes.
+TEST(OpeningBookTest, RepliesLikeChooseIntent) {
+  MasterMind initial("rgbyop", 4);
+  initial.set_score_table(initial.BuildScoreTable(64 << 20));
+  auto book = OpeningBook::Build(initial, 2);
+  EXPECT_EQ(initial.ChooseInitialIntent(),
+            book->initial_partition(initial.num_positions()));
+  int num_positions = initial.num_positions();
+  int num_colors = initial.colors().size();
+  MasterMind::ColorComb first_intent = 0;
+  for (int i = 0; i < num_positions; i++) {
+    int color = initial.Color(book->initial_intent(), (i + 1) % num_positions);
+    first_intent = (first_intent << 4) | ((color + 1) % num_colors);
+  }
+  int lookups = 0;
+  for (auto t = initial.target_candidates_begin();
+       t != initial.target_candidates_end(); ++t) {
+    MasterMind game(initial);
+    vector<MasterMind::ColorComb> intents;
+    vector<pair<int, int>> evaluations;
+    MasterMind::ColorComb intent = first_intent, reply;
+    while (true) {
+      auto bw = game.Evaluate(*t, intent);
+      game.Update(intent, bw.first, bw.second);
+      intents.push_back(intent);
+      evaluations.push_back(bw);
+      if (bw.first == num_positions ||
+          !book->Reply(game, intents, evaluations, &reply))
+        break;
+      lookups++;
+      MasterMind::ColorComb computed = game.num_candidates() == 1 ?
+          *game.target_candidates_begin() : game.ChooseIntent();
+      EXPECT_NEAR(game.Entropy(computed), game.Entropy(reply), 1e-9)
+          << initial.cc2string(*t) << ": book " << game.cc2string(reply)
+          << ", computed " << game.cc2string(computed);
+      intent = reply;
+    }
+  }
+  EXPECT_GT(lookups, initial.num_candidates());
+}
+
+}  // namespace
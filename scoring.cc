@@ -0,0 +1,188 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include "scoring.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MASTERMIND_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static uint64_t PositionBits(int num_positions) {
+  uint64_t position_bits = 0;
+  for (int i = 0; i < num_positions; i++)
+    position_bits = (position_bits << 4) | 1;
+  return position_bits;
+}
+
+void ScoreBatchScalar(
+    const uint64_t* targets, const uint64_t* target_counts, size_t num_targets,
+    uint64_t intent, uint64_t intent_counts, int num_positions,
+    const uint8_t* result_index, int* counter) {
+  uint64_t position_bits = PositionBits(num_positions);
+  for (size_t i = 0; i < num_targets; i++) {
+    int common;
+    int black = ScoreKernel(targets[i], target_counts[i], intent, intent_counts,
+                            position_bits, num_positions, &common);
+    counter[result_index[16 * black + common]]++;
+  }
+}
+
+void CountMasksScalar(
+    const uint64_t* live, const uint32_t* live_words, size_t num_live_words,
+    const uint64_t* masks, int num_results, int* counter) {
+  for (size_t i = 0; i < num_live_words; i++) {
+    uint32_t w = live_words[i];
+    const uint64_t* word_masks = masks + static_cast<size_t>(w) * num_results;
+    for (int r = 0; r < num_results; r++)
+      counter[r] += __builtin_popcountll(live[w] & word_masks[r]);
+  }
+}
+
+#ifdef MASTERMIND_X86_DISPATCH
+
+// The same code, but __builtin_popcountll becomes a single instruction
+// instead of a sequence of shifts and masks.
+__attribute__((target("popcnt")))
+static void CountMasksPopcntImpl(
+    const uint64_t* live, const uint32_t* live_words, size_t num_live_words,
+    const uint64_t* masks, int num_results, int* counter) {
+  for (size_t i = 0; i < num_live_words; i++) {
+    uint32_t w = live_words[i];
+    const uint64_t* word_masks = masks + static_cast<size_t>(w) * num_results;
+    for (int r = 0; r < num_results; r++)
+      counter[r] += __builtin_popcountll(live[w] & word_masks[r]);
+  }
+}
+
+// The vectorized versions do the same as ScoreKernel on every 64 bit lane,
+// except that the nibbles and counts are added up by spreading them over
+// bytes and summing those with psadbw. They only differ in register width.
+
+__attribute__((target("sse4.2")))
+static void ScoreBatchSse42Impl(
+    const uint64_t* targets, const uint64_t* target_counts, size_t num_targets,
+    uint64_t intent, uint64_t intent_counts, int num_positions,
+    const uint8_t* result_index, int* counter) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i low = _mm_set1_epi8(0x0F);
+  const __m128i bits = _mm_set1_epi64x(PositionBits(num_positions));
+  const __m128i c = _mm_set1_epi64x(intent);
+  const __m128i c_counts = _mm_set1_epi64x(intent_counts);
+  const __m128i c_even = _mm_and_si128(c_counts, low);
+  const __m128i c_odd = _mm_and_si128(_mm_srli_epi64(c_counts, 4), low);
+  uint64_t differ[2], common[2];
+  size_t i = 0;
+  for (; i + 2 <= num_targets; i += 2) {
+    __m128i d = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(targets + i)), c);
+    d = _mm_or_si128(d, _mm_srli_epi64(d, 1));
+    d = _mm_or_si128(d, _mm_srli_epi64(d, 2));
+    d = _mm_and_si128(d, bits);
+    d = _mm_add_epi8(_mm_and_si128(d, low),
+                     _mm_and_si128(_mm_srli_epi64(d, 4), low));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(differ), _mm_sad_epu8(d, zero));
+
+    __m128i t = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(target_counts + i));
+    __m128i m = _mm_add_epi8(
+        _mm_min_epu8(_mm_and_si128(t, low), c_even),
+        _mm_min_epu8(_mm_and_si128(_mm_srli_epi64(t, 4), low), c_odd));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(common), _mm_sad_epu8(m, zero));
+
+    for (int lane = 0; lane < 2; lane++) {
+      int black = num_positions - static_cast<int>(differ[lane]);
+      counter[result_index[16 * black + common[lane]]]++;
+    }
+  }
+  ScoreBatchScalar(targets + i, target_counts + i, num_targets - i,
+                   intent, intent_counts, num_positions, result_index, counter);
+}
+
+__attribute__((target("avx2")))
+static void ScoreBatchAvx2Impl(
+    const uint64_t* targets, const uint64_t* target_counts, size_t num_targets,
+    uint64_t intent, uint64_t intent_counts, int num_positions,
+    const uint8_t* result_index, int* counter) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i low = _mm256_set1_epi8(0x0F);
+  const __m256i bits = _mm256_set1_epi64x(PositionBits(num_positions));
+  const __m256i c = _mm256_set1_epi64x(intent);
+  const __m256i c_counts = _mm256_set1_epi64x(intent_counts);
+  const __m256i c_even = _mm256_and_si256(c_counts, low);
+  const __m256i c_odd = _mm256_and_si256(_mm256_srli_epi64(c_counts, 4), low);
+  uint64_t differ[4], common[4];
+  size_t i = 0;
+  for (; i + 4 <= num_targets; i += 4) {
+    __m256i d = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(targets + i)), c);
+    d = _mm256_or_si256(d, _mm256_srli_epi64(d, 1));
+    d = _mm256_or_si256(d, _mm256_srli_epi64(d, 2));
+    d = _mm256_and_si256(d, bits);
+    d = _mm256_add_epi8(_mm256_and_si256(d, low),
+                        _mm256_and_si256(_mm256_srli_epi64(d, 4), low));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(differ),
+                        _mm256_sad_epu8(d, zero));
+
+    __m256i t = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(target_counts + i));
+    __m256i m = _mm256_add_epi8(
+        _mm256_min_epu8(_mm256_and_si256(t, low), c_even),
+        _mm256_min_epu8(_mm256_and_si256(_mm256_srli_epi64(t, 4), low), c_odd));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(common),
+                        _mm256_sad_epu8(m, zero));
+
+    for (int lane = 0; lane < 4; lane++) {
+      int black = num_positions - static_cast<int>(differ[lane]);
+      counter[result_index[16 * black + common[lane]]]++;
+    }
+  }
+  ScoreBatchScalar(targets + i, target_counts + i, num_targets - i,
+                   intent, intent_counts, num_positions, result_index, counter);
+}
+
+const ScoreBatchFunction ScoreBatchSse42 = ScoreBatchSse42Impl;
+const ScoreBatchFunction ScoreBatchAvx2 = ScoreBatchAvx2Impl;
+
+const CountMasksFunction CountMasksPopcnt = CountMasksPopcntImpl;
+
+ScoreBatchFunction BestScoreBatch() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return ScoreBatchAvx2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return ScoreBatchSse42;
+  return ScoreBatchScalar;
+}
+
+CountMasksFunction BestCountMasks() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("popcnt"))
+    return CountMasksPopcnt;
+  return CountMasksScalar;
+}
+
+#else
+
+const ScoreBatchFunction ScoreBatchSse42 = nullptr;
+const ScoreBatchFunction ScoreBatchAvx2 = nullptr;
+const CountMasksFunction CountMasksPopcnt = nullptr;
+
+ScoreBatchFunction BestScoreBatch() {
+  return ScoreBatchScalar;
+}
+
+CountMasksFunction BestCountMasks() {
+  return CountMasksScalar;
+}
+
+#endif // MASTERMIND_X86_DISPATCH
+
+const char* ScoreBatchName(ScoreBatchFunction score_batch) {
+  if (score_batch == ScoreBatchScalar)
+    return "scalar";
+  if (score_batch == ScoreBatchSse42)
+    return "sse4.2";
+  if (score_batch == ScoreBatchAvx2)
+    return "avx2";
+  return "unknown";
+}
@@ -0,0 +1,84 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef SCORING_H_
+#define SCORING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Scoring kernels on packed color combinations and color counts, see
+// MasterMind::ColorComb and MasterMind::ColorCounts. position_bits has the
+// lowest bit of the nibble of every position set.
+
+// Returns the number of black, and sets *common to black + white, without
+// branching: black is the number of equal nibbles, and black + white is the
+// sum over all colors of the minimum of both counts.
+inline int ScoreKernel(uint64_t target, uint64_t target_counts,
+                       uint64_t intent, uint64_t intent_counts,
+                       uint64_t position_bits, int num_positions,
+                       int* common) {
+  // The lowest bit of every nibble of differ is set iff the colors differ
+  uint64_t differ = target ^ intent;
+  differ |= differ >> 1;
+  differ |= differ >> 2;
+  differ &= position_bits;
+  // adding up nibbles by multiplication doesn't overflow as there are at
+  // most 15 of them
+  const uint64_t kNibbles = 0x1111111111111111;
+  int black = num_positions - static_cast<int>((differ * kNibbles) >> 60);
+  // Spread the counts of even and odd colors over bytes, such that
+  // subtraction doesn't borrow across them. The high bit of every byte
+  // of the difference tells which count is smaller.
+  const uint64_t kLow = 0x0F0F0F0F0F0F0F0F, kHigh = 0x8080808080808080;
+  const uint64_t kBytes = 0x0101010101010101;
+  uint64_t sum = 0;
+  for (int shift = 0; shift < 8; shift += 4) {
+    uint64_t t = (target_counts >> shift) & kLow;
+    uint64_t c = (intent_counts >> shift) & kLow;
+    uint64_t intent_not_smaller = (((c | kHigh) - t) & kHigh) >> 7;
+    intent_not_smaller *= 0xFF;
+    sum += (t & intent_not_smaller) | (c & ~intent_not_smaller);
+  }
+  *common = static_cast<int>((sum * kBytes) >> 56);
+  return black;
+}
+
+// Scores one intent against num_targets targets, and for each of them
+// increments counter[result_index[16 * black + black + white]].
+using ScoreBatchFunction = void (*)(
+    const uint64_t* targets, const uint64_t* target_counts, size_t num_targets,
+    uint64_t intent, uint64_t intent_counts, int num_positions,
+    const uint8_t* result_index, int* counter);
+
+void ScoreBatchScalar(
+    const uint64_t* targets, const uint64_t* target_counts, size_t num_targets,
+    uint64_t intent, uint64_t intent_counts, int num_positions,
+    const uint8_t* result_index, int* counter);
+
+// The vectorized versions may only be called if the cpu supports them, and
+// are null if the compiler doesn't.
+extern const ScoreBatchFunction ScoreBatchSse42;
+extern const ScoreBatchFunction ScoreBatchAvx2;
+
+const char* ScoreBatchName(ScoreBatchFunction score_batch);
+
+// Counts the results of an intent on a set of targets given as a bitset
+// live over all codes, using the masks of the intent (see PartitionMasks):
+// for every word w in live_words, adds the number of bits set in both live[w]
+// and masks[w * num_results + r] to counter[r]. The other words of live must
+// be 0.
+using CountMasksFunction = void (*)(
+    const uint64_t* live, const uint32_t* live_words, size_t num_live_words,
+    const uint64_t* masks, int num_results, int* counter);
+
+void CountMasksScalar(
+    const uint64_t* live, const uint32_t* live_words, size_t num_live_words,
+    const uint64_t* masks, int num_results, int* counter);
+
+// Uses the popcnt instruction, null if the compiler doesn't support it.
+extern const CountMasksFunction CountMasksPopcnt;
+
+// The fastest versions supported by the cpu, determined at runtime.
+ScoreBatchFunction BestScoreBatch();
+CountMasksFunction BestCountMasks();
+
+#endif // SCORING_H_
@@ -0,0 +1,201 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <sstream>
+using namespace std;
+
+#include "server.h"
+
+GameServer::GameServer(const MasterMind& initial,
+                       shared_ptr<const OpeningBook> book, int num_threads,
+                       Output output, double hint_seconds)
+    : initial_(initial), book_(book),
+      initial_intent_(book ? book->initial_intent() :
+                      initial.InitialIntent(initial.ChooseInitialIntent())),
+      output_(output), hint_seconds_(hint_seconds), updates_(0), hints_(0),
+      errors_(0), late_hints_(0) {
+  for (int t = 0; t < max(1, num_threads); t++)
+    workers_.emplace_back(&GameServer::Work, this);
+}
+
+GameServer::~GameServer() {
+  Wait();
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_.notify_all();
+  for (auto& worker: workers_)
+    worker.join();
+}
+
+void GameServer::Submit(const string& request) {
+  istringstream in(request);
+  string id;
+  if (!(in >> id))
+    return;
+  {
+    lock_guard<mutex> lock(mutex_);
+    unique_ptr<Game>& game = games_[id];
+    if (!game)
+      game.reset(new Game);
+    game->requests.push_back(Request{request, chrono::steady_clock::now()});
+    num_pending_++;
+    if (game->scheduled)
+      return;
+    game->scheduled = true;
+    ready_.push_back(id);
+  }
+  work_.notify_one();
+}
+
+void GameServer::Wait() {
+  unique_lock<mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return num_pending_ == 0; });
+}
+
+size_t GameServer::num_games() const {
+  lock_guard<mutex> lock(mutex_);
+  return games_.size();
+}
+
+GameServer::Stats GameServer::stats() const {
+  Stats stats;
+  stats.updates = updates_;
+  stats.hints = hints_;
+  stats.errors = errors_;
+  stats.late_hints = late_hints_;
+  return stats;
+}
+
+void GameServer::Work() {
+  Context context{initial_, {}, {}};
+  // The pool provides the parallelism
+  context.game.set_num_threads(1);
+  // The games are replayed much more often than their hints are computed,
+  // most of which are found in the book or the decision cache, so pruning
+  // costs far more than it saves
+  context.game.set_prune_intents(false);
+  unique_lock<mutex> lock(mutex_);
+  while (true) {
+    work_.wait(lock, [this]() { return stopping_ || !ready_.empty(); });
+    if (ready_.empty())
+      return;
+    string id = ready_.front();
+    ready_.pop_front();
+    Game* game = games_.at(id).get();
+    // Only this worker touches the game's history until it is scheduled
+    // again
+    while (!game->requests.empty()) {
+      Request request = game->requests.front();
+      game->requests.pop_front();
+      lock.unlock();
+      string response = Handle(id, request, game, &context);
+      {
+        lock_guard<mutex> output_lock(output_mutex_);
+        output_(response);
+      }
+      lock.lock();
+      if (--num_pending_ == 0)
+        idle_.notify_all();
+    }
+    game->scheduled = false;
+    if (game->intents.empty())
+      games_.erase(id);
+  }
+}
+
+void GameServer::Replay(const Game& game, Context* context) const {
+  size_t common = 0;
+  while (common < context->intents.size() && common < game.intents.size() &&
+         context->intents[common] == game.intents[common] &&
+         context->evaluations[common] == game.evaluations[common])
+    common++;
+  while (context->intents.size() > common) {
+    context->game.Undo();
+    context->intents.pop_back();
+    context->evaluations.pop_back();
+  }
+  for (size_t i = common; i < game.intents.size(); i++) {
+    context->game.Update(game.intents[i], game.evaluations[i].first,
+                         game.evaluations[i].second);
+    context->intents.push_back(game.intents[i]);
+    context->evaluations.push_back(game.evaluations[i]);
+  }
+}
+
+MasterMind::ColorComb GameServer::ChooseIntent(const MasterMind& state,
+                                               const Request& request) {
+  if (hint_seconds_ <= 0)
+    return state.ChooseIntent();
+  MasterMind::SearchLimits limits;
+  limits.deadline = request.submitted +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(hint_seconds_));
+  MasterMind::SearchStats stats;
+  MasterMind::ColorComb intent = state.ChooseIntent(limits, &stats);
+  if (!stats.complete())
+    late_hints_++;
+  return intent;
+}
+
+string GameServer::Handle(const string& id, const Request& request,
+                          Game* game, Context* context) {
+  istringstream in(request.line);
+  string request_id, command;
+  if (!(in >> request_id >> command)) {
+    errors_++;
+    return id + " error usage: <id> update|hint|end";
+  }
+  MasterMind& state = context->game;
+  if (command == "update") {
+    string intent;
+    int black, white;
+    string rest;
+    if (!(in >> intent >> black >> white) || (in >> rest)) {
+      errors_++;
+      return id + " error usage: <id> update <intent> <black> <white>";
+    }
+    if (!state.ValidIntent(intent)) {
+      errors_++;
+      return id + " error invalid intent " + intent;
+    }
+    if (!state.ValidEvaluation(black, white)) {
+      errors_++;
+      return id + " error invalid evaluation";
+    }
+    Replay(*game, context);
+    MasterMind::ColorComb cc = state.string2cc(intent);
+    state.Update(cc, black, white);
+    if (state.num_candidates() == 0) {
+      state.Undo();
+      errors_++;
+      return id + " error no possible targets left";
+    }
+    game->intents.push_back(cc);
+    game->evaluations.emplace_back(black, white);
+    context->intents.push_back(cc);
+    context->evaluations.emplace_back(black, white);
+    updates_++;
+    return id + " ok " + to_string(state.num_candidates());
+  }
+  if (command == "hint") {
+    MasterMind::ColorComb intent = initial_intent_;
+    if (!game->intents.empty()) {
+      Replay(*game, context);
+      if (state.num_candidates() == 1)
+        intent = *state.target_candidates_begin();
+      else if (!book_ || !book_->Reply(state, game->intents,
+                                       game->evaluations, &intent))
+        intent = ChooseIntent(state, request);
+    }
+    hints_++;
+    return id + " hint " + state.cc2string(intent);
+  }
+  if (command == "end") {
+    game->intents.clear();
+    game->evaluations.clear();
+    return id + " ended";
+  }
+  errors_++;
+  return id + " error unknown request " + command;
+}
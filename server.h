@@ -0,0 +1,133 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mastermind.h"
+#include "opening_book.h"
+
+// Serves the hints of many concurrent games, multiplexed in one stream of
+// requests, one per line:
+//   <id> update <intent> <black> <white>   answered by  <id> ok <targets>
+//   <id> hint                              answered by  <id> hint <intent>
+//   <id> end                               answered by  <id> ended
+// where id is any word naming the game, and targets is the number of
+// possible targets left. A game starts when its id is first used, and ends
+// with end, after which the id may be used for a new game. Malformed or
+// inconsistent requests are answered by "<id> error <reason>" and leave the
+// game as it was.
+//
+// The requests are handled by a pool of worker threads. The requests of a
+// game are handled in order, one at a time, but those of different games in
+// parallel, so the responses of different games may come in any order.
+//
+// A game only keeps its intents and their evaluations. Each worker has a
+// MasterMind of its own, and brings it to the state of the game it handles
+// by undoing the updates that aren't part of that game's history and
+// replaying the rest; games with the same first turns share them. Hints
+// are looked up in the opening book if given, and the games share the
+// decision cache of the initial game if it has one.
+//
+// With a hint deadline, the intents computed for hints are those of an
+// anytime search (see MasterMind::SearchLimits) that stops that long after
+// the request was submitted, so that a hint comes in time even when the
+// game has many possible targets or the workers are busy.
+class GameServer {
+ public:
+  // Called with every response, without the newline, one at a time, from
+  // the workers. It may submit requests.
+  using Output = std::function<void(const std::string& response)>;
+
+  struct Stats {
+    uint64_t updates = 0;
+    uint64_t hints = 0;
+    uint64_t errors = 0;
+    // hints whose search the deadline stopped
+    uint64_t late_hints = 0;
+  };
+
+  // Serves games like initial, which should be in its initial state, with
+  // the score table, strategy and decision cache to use. book may be null.
+  // hint_seconds is the hint deadline, 0 meaning none.
+  GameServer(const MasterMind& initial,
+             std::shared_ptr<const OpeningBook> book, int num_threads,
+             Output output, double hint_seconds = 0);
+  // Answers the requests submitted so far before returning.
+  ~GameServer();
+
+  // Queues a request. Empty lines are ignored.
+  void Submit(const std::string& request);
+  // Waits until all requests submitted so far are answered.
+  void Wait();
+
+  // The games with a history or pending requests
+  size_t num_games() const;
+  Stats stats() const;
+
+ private:
+  struct Request {
+    std::string line;
+    std::chrono::steady_clock::time_point submitted;
+  };
+
+  struct Game {
+    std::vector<MasterMind::ColorComb> intents;
+    std::vector<std::pair<int, int>> evaluations;
+    std::deque<Request> requests;
+    // queued for or handled by a worker
+    bool scheduled = false;
+  };
+
+  // A worker's own game, in the state after its intents and evaluations
+  struct Context {
+    MasterMind game;
+    std::vector<MasterMind::ColorComb> intents;
+    std::vector<std::pair<int, int>> evaluations;
+  };
+
+  void Work();
+  // Brings context to the state of game
+  void Replay(const Game& game, Context* context) const;
+  // The intent of a hint in state, within the hint deadline of request
+  MasterMind::ColorComb ChooseIntent(const MasterMind& state,
+                                     const Request& request);
+  // The response to request, updating game
+  std::string Handle(const std::string& id, const Request& request,
+                     Game* game, Context* context);
+
+  const MasterMind initial_;
+  const std::shared_ptr<const OpeningBook> book_;
+  const MasterMind::ColorComb initial_intent_;
+  const Output output_;
+  const double hint_seconds_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable idle_;
+  // by id, as long as they have a history or requests
+  std::unordered_map<std::string, std::unique_ptr<Game>> games_;
+  // the ids of the games with requests that no worker is handling
+  std::deque<std::string> ready_;
+  // submitted and not answered yet
+  size_t num_pending_ = 0;
+  bool stopping_ = false;
+
+  std::mutex output_mutex_;
+  std::atomic<uint64_t> updates_, hints_, errors_, late_hints_;
+  std::vector<std::thread> workers_;
+};
+
+#endif // SERVER_H_
@@ -0,0 +1,163 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "mastermind.h"
+#include "server.h"
+
+namespace {
+
+// The responses of a server, by game
+class Responses {
+ public:
+  void Add(const string& response) {
+    lock_guard<mutex> lock(mutex_);
+    istringstream in(response);
+    string id;
+    in >> id;
+    by_game_[id].push_back(response);
+  }
+
+  vector<string> Of(const string& id) {
+    lock_guard<mutex> lock(mutex_);
+    return by_game_[id];
+  }
+
+ private:
+  mutex mutex_;
+  map<string, vector<string>> by_game_;
+};
+
+TEST(GameServerTest, Requests) {
+  MasterMind game("rgbyop", 4);
+  Responses responses;
+  GameServer server(game, nullptr, 2, [&](const string& response) {
+      responses.Add(response);
+    });
+  server.Submit("a hint");
+  server.Submit("a update rgby 1 1");
+  server.Submit("b update rrrr 0 0");
+  server.Submit("a update rgby 4 1");
+  server.Submit("a update rgbx 1 1");
+  server.Submit("a update rgb 1 1");
+  server.Submit("a update rrrr 4 0");
+  server.Submit("a guess");
+  server.Submit("");
+  // not a command of the game hint
+  server.Submit("hint");
+  server.Submit("a end");
+  server.Wait();
+  vector<string> a = responses.Of("a");
+  ASSERT_EQ(8u, a.size());
+  EXPECT_EQ("a hint " + game.cc2string(
+      game.InitialIntent(game.ChooseInitialIntent())), a[0]);
+  EXPECT_EQ("a ok 252", a[1]);
+  EXPECT_EQ("a error invalid evaluation", a[2]);
+  EXPECT_EQ("a error invalid intent rgbx", a[3]);
+  EXPECT_EQ("a error invalid intent rgb", a[4]);
+  // rrrr would have scored 1 0 against rgby
+  EXPECT_EQ("a error no possible targets left", a[5]);
+  EXPECT_EQ("a error unknown request guess", a[6]);
+  EXPECT_EQ("a ended", a[7]);
+  EXPECT_EQ((vector<string>{"b ok 625"}), responses.Of("b"));
+  EXPECT_EQ((vector<string>{"hint error usage: <id> update|hint|end"}),
+            responses.Of("hint"));
+  EXPECT_EQ(6u, server.stats().errors);
+  EXPECT_EQ(2u, server.stats().updates);
+  EXPECT_EQ(1u, server.stats().hints);
+  EXPECT_EQ(1u, server.num_games());
+}
+
+// Many games at the same time must get the hints ChooseIntent gives when
+// playing alone
+TEST(GameServerTest, ConcurrentGames) {
+  MasterMind game("rgbyop", 4);
+  game.set_score_table(game.BuildScoreTable(64 << 20));
+  vector<MasterMind::ColorComb> secrets;
+  for (int i = 0; i < 40; i++)
+    secrets.push_back(game.target_candidates_begin()[i * 31]);
+
+  // the hints of every game, and the evaluations of those
+  vector<vector<string>> expected(secrets.size());
+  for (size_t i = 0; i < secrets.size(); i++) {
+    MasterMind alone(game);
+    MasterMind::ColorComb intent =
+        alone.InitialIntent(alone.ChooseInitialIntent());
+    while (true) {
+      expected[i].push_back(alone.cc2string(intent));
+      if (intent == secrets[i])
+        break;
+      auto bw = alone.Evaluate(secrets[i], intent);
+      alone.Update(intent, bw.first, bw.second);
+      intent = alone.num_candidates() == 1 ?
+          *alone.target_candidates_begin() : alone.ChooseIntent();
+    }
+  }
+
+  // All games take turns, interleaving their requests
+  Responses responses;
+  GameServer server(game, nullptr, 3, [&](const string& response) {
+      responses.Add(response);
+    });
+  for (size_t turn = 0; ; turn++) {
+    bool any = false;
+    for (size_t i = 0; i < secrets.size(); i++) {
+      if (turn >= expected[i].size())
+        continue;
+      any = true;
+      string id = to_string(i);
+      if (turn > 0) {
+        MasterMind::ColorComb intent = game.string2cc(expected[i][turn - 1]);
+        auto bw = game.Evaluate(secrets[i], intent);
+        server.Submit(id + " update " + expected[i][turn - 1] + " " +
+                      to_string(bw.first) + " " + to_string(bw.second));
+      }
+      server.Submit(id + " hint");
+    }
+    if (!any)
+      break;
+  }
+  server.Wait();
+  for (size_t i = 0; i < secrets.size(); i++) {
+    vector<string> hints;
+    for (auto& response: responses.Of(to_string(i))) {
+      EXPECT_EQ(string::npos, response.find("error")) << response;
+      if (response.find(" hint ") != string::npos)
+        hints.push_back(response.substr(response.rfind(' ') + 1));
+    }
+    EXPECT_EQ(expected[i], hints) << game.cc2string(secrets[i]);
+  }
+  EXPECT_EQ(secrets.size(), server.num_games());
+}
+
+// Past the hint deadline, a hint is the first intent rated, which is a
+// possible target
+TEST(GameServerTest, HintDeadline) {
+  MasterMind game("rgbyopcm", 4);
+  Responses responses;
+  {
+    GameServer server(game, nullptr, 1, [&](const string& response) {
+        responses.Add(response);
+      }, 1e-9);
+    server.Submit("a update rrgb 1 0");
+    server.Submit("a hint");
+    server.Wait();
+    EXPECT_EQ(1u, server.stats().late_hints);
+  }
+  vector<string> a = responses.Of("a");
+  ASSERT_EQ(2u, a.size());
+  string hint = a[1].substr(a[1].rfind(' ') + 1);
+  EXPECT_EQ(make_pair(1, 0), game.Evaluate(game.string2cc(hint),
+                                           game.string2cc("rrgb")))
+      << a[1];
+}
+
+}  // namespace
@@ -0,0 +1,293 @@
+// -*- eval: (google-set-c-style) -*-
+
+// Plays the assistant against every possible secret (or a sample of them)
+// and reports the distribution of the number of guesses it needs, and how
+// long it takes to choose its intents. Games run in parallel, and share
+// the intents chosen in the states they reach: as the choice only depends
+// on the possible targets, the games share a DecisionCache, and only the
+// first game reaching a state computes its intent.
+//
+// With --race n, the intents are approximated by EstimateIntent with a
+// budget of n scorings instead, to compare the number of guesses and the
+// time with exact ChooseIntent. They are not shared, but ChooseIntent still
+// is, to count how often the approximation agrees with it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "mastermind.h"
+#include "cache.h"
+#include "decision_cache.h"
+#include "opening_book.h"
+
+namespace {
+
+// Like the interactive program
+const size_t kScoreTableBudget = 64 << 20;
+
+// The default size of the decision cache, which is more than the number
+// of states with more than one possible target of most games
+const size_t kDecisionCacheSize = size_t(1) << 20;
+
+// How the intents of a move (turn) were found over all games
+struct MoveStats {
+  uint64_t computed = 0;
+  uint64_t shared = 0;
+  uint64_t book = 0;
+  // only one possible target was left
+  uint64_t forced = 0;
+  // of the computed ones, with --race: the intents of ChooseIntent's
+  // entropy
+  uint64_t optimal = 0;
+  double seconds = 0;
+  // of the Updates with the evaluation of the previous intent
+  double update_seconds = 0;
+
+  void Add(const MoveStats& other) {
+    computed += other.computed;
+    shared += other.shared;
+    book += other.book;
+    forced += other.forced;
+    optimal += other.optimal;
+    seconds += other.seconds;
+    update_seconds += other.update_seconds;
+  }
+};
+
+struct Results {
+  // histogram[g] is the number of secrets found with g guesses
+  vector<uint64_t> histogram;
+  // moves[m] for the m-th intent, m >= 2
+  vector<MoveStats> moves;
+  // the counters of the games of a thread
+  MasterMind::Stats engine;
+
+  void Add(const Results& other) {
+    if (histogram.size() < other.histogram.size())
+      histogram.resize(other.histogram.size());
+    for (size_t g = 0; g < other.histogram.size(); g++)
+      histogram[g] += other.histogram[g];
+    if (moves.size() < other.moves.size())
+      moves.resize(other.moves.size());
+    for (size_t m = 0; m < other.moves.size(); m++)
+      moves[m].Add(other.moves[m]);
+    engine.Add(other.engine);
+  }
+};
+
+void usage() {
+  printf("Usage: mastermind-sim [--strategy entropy|minimax|most-parts|"
+         "expected-size]\n"
+         "                      [--sample n] [--threads n] [--no-share] "
+         "[--cache-size n]\n"
+         "                      [--race n] [--stats]\n"
+         "                      colors positions\n"
+         "with 1 to %d distinct colors and 1 to %d positions\n",
+         MasterMind::kMaxColors, MasterMind::kMaxPositions);
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  MasterMind::Strategy strategy = MasterMind::Strategy::kEntropy;
+  size_t sample = 0;
+  int num_threads = max(1u, thread::hardware_concurrency());
+  bool share = true;
+  bool print_stats = false;
+  size_t cache_size = kDecisionCacheSize;
+  uint64_t race = 0;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    string option = argv[arg];
+    if (option == "--no-share") {
+      share = false;
+    } else if (option == "--stats") {
+      print_stats = true;
+    } else if (arg + 1 == argc) {
+      usage();
+    } else if (option == "--strategy") {
+      if (!MasterMind::ParseStrategy(argv[++arg], &strategy))
+        usage();
+    } else if (option == "--sample") {
+      sample = atol(argv[++arg]);
+    } else if (option == "--threads") {
+      num_threads = max(1, atoi(argv[++arg]));
+    } else if (option == "--cache-size") {
+      cache_size = atol(argv[++arg]);
+    } else if (option == "--race") {
+      race = max(1l, atol(argv[++arg]));
+    } else {
+      usage();
+    }
+  }
+  if (argc - arg != 2 || !MasterMind::Valid(argv[arg], atoi(argv[arg + 1])))
+    usage();
+
+  MasterMind initial(argv[arg], atoi(argv[arg + 1]));
+  initial.set_strategy(strategy);
+  // Games run on all threads already
+  initial.set_num_threads(1);
+  if (share)
+    initial.set_decision_cache(make_shared<DecisionCache>(cache_size));
+  shared_ptr<const GameCache> cache = GameCache::Load(
+      GameCache::Path(initial.colors().size(), initial.num_positions()),
+      initial);
+  initial.set_score_table(
+      cache && cache->score_table() ? cache->score_table() :
+      initial.BuildScoreTable(kScoreTableBudget));
+  // The book has the hints of the entropy strategy
+  shared_ptr<const OpeningBook> book =
+      cache && strategy == MasterMind::Strategy::kEntropy ?
+      cache->book() : nullptr;
+  MasterMind::ColorComb first_intent = book ? book->initial_intent() :
+      initial.InitialIntent(initial.ChooseInitialIntent());
+
+  vector<MasterMind::ColorComb> secrets(initial.target_candidates_begin(),
+                                        initial.target_candidates_end());
+  if (sample > 0 && sample < secrets.size()) {
+    // the same sample every run
+    mt19937_64 random(1);
+    for (size_t i = 0; i < sample; i++)
+      swap(secrets[i], secrets[i + random() % (secrets.size() - i)]);
+    secrets.resize(sample);
+    sort(secrets.begin(), secrets.end());
+  }
+
+  atomic<size_t> next(0);
+  vector<Results> results(num_threads);
+  auto play = [&](int thread_index) {
+    MasterMind game(initial);
+    game.ResetStats();
+    Results& result = results[thread_index];
+    for (size_t i = next++; i < secrets.size(); i = next++) {
+      MasterMind::ColorComb secret = secrets[i];
+      vector<MasterMind::ColorComb> intents;
+      vector<pair<int, int>> evaluations;
+      MasterMind::ColorComb intent = first_intent;
+      while (intent != secret) {
+        auto bw = game.Evaluate(secret, intent);
+        auto update_start = chrono::steady_clock::now();
+        game.Update(intent, bw.first, bw.second);
+        double update_seconds = chrono::duration<double>(
+            chrono::steady_clock::now() - update_start).count();
+        intents.push_back(intent);
+        evaluations.push_back(bw);
+        size_t move = intents.size() + 1;
+        if (result.moves.size() <= move)
+          result.moves.resize(move + 1);
+        MoveStats& stats = result.moves[move];
+        stats.update_seconds += update_seconds;
+        if (game.num_candidates() == 1) {
+          intent = *game.target_candidates_begin();
+          stats.forced++;
+        } else if (book &&
+                   book->Reply(game, intents, evaluations, &intent)) {
+          stats.book++;
+        } else if (race > 0) {
+          MasterMind::SampleBudget budget;
+          budget.scorings = race;
+          auto start = chrono::steady_clock::now();
+          intent = game.EstimateIntent(budget);
+          stats.seconds += chrono::duration<double>(
+              chrono::steady_clock::now() - start).count();
+          stats.computed++;
+          stats.optimal += game.Entropy(intent) >
+              game.Entropy(game.ChooseIntent()) - 1e-9;
+        } else {
+          auto start = chrono::steady_clock::now();
+          MasterMind::SearchStats search_stats;
+          intent = game.ChooseIntent(&search_stats);
+          double seconds = chrono::duration<double>(
+              chrono::steady_clock::now() - start).count();
+          if (search_stats.cached) {
+            stats.shared++;
+          } else {
+            stats.computed++;
+            stats.seconds += seconds;
+          }
+        }
+      }
+      size_t guesses = intents.size() + 1;
+      if (result.histogram.size() <= guesses)
+        result.histogram.resize(guesses + 1);
+      result.histogram[guesses]++;
+      while (game.num_updates() > 0)
+        game.Undo();
+    }
+    result.engine = game.stats();
+  };
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (int t = 1; t < num_threads; t++)
+    threads.emplace_back(play, t);
+  play(0);
+  for (auto& t: threads)
+    t.join();
+  double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  Results total;
+  for (auto& result: results)
+    total.Add(result);
+  uint64_t num_guesses = 0, max_guesses = 0;
+  for (size_t g = 0; g < total.histogram.size(); g++) {
+    num_guesses += g * total.histogram[g];
+    if (total.histogram[g] > 0)
+      max_guesses = g;
+  }
+  printf("%zu secrets, %s strategy, first intent %s, %d threads\n",
+         secrets.size(), race > 0 ? "raced entropy" :
+         MasterMind::StrategyName(strategy),
+         initial.cc2string(first_intent).c_str(), num_threads);
+  printf("average %.4f, max %llu guesses\n",
+         double(num_guesses) / secrets.size(),
+         (unsigned long long)max_guesses);
+  for (size_t g = 1; g < total.histogram.size(); g++)
+    printf("%3zu guesses: %llu\n", g, (unsigned long long)total.histogram[g]);
+  printf("move  ms/update  computed  ms/computed  shared  book  forced\n");
+  for (size_t m = 2; m < total.moves.size(); m++) {
+    const MoveStats& stats = total.moves[m];
+    uint64_t num_moves =
+        stats.computed + stats.shared + stats.book + stats.forced;
+    printf("%4zu  %9.3f  %8llu  %11.3f  %6llu  %4llu  %6llu\n", m,
+           1000 * stats.update_seconds / num_moves,
+           (unsigned long long)stats.computed,
+           stats.computed > 0 ? 1000 * stats.seconds / stats.computed : 0.0,
+           (unsigned long long)stats.shared, (unsigned long long)stats.book,
+           (unsigned long long)stats.forced);
+  }
+  if (race > 0) {
+    uint64_t computed = 0, optimal = 0;
+    for (auto& stats: total.moves) {
+      computed += stats.computed;
+      optimal += stats.optimal;
+    }
+    printf("raced with %llu scorings: %llu of %llu intents of maximal "
+           "entropy\n", (unsigned long long)race,
+           (unsigned long long)optimal, (unsigned long long)computed);
+  }
+  if (initial.decision_cache()) {
+    DecisionCache::Stats cache_stats = initial.decision_cache()->stats();
+    printf("decision cache: %zu entries, %llu hits, %llu misses, "
+           "%llu evictions\n", initial.decision_cache()->size(),
+           (unsigned long long)cache_stats.hits,
+           (unsigned long long)cache_stats.misses,
+           (unsigned long long)cache_stats.evictions);
+  }
+  if (print_stats)
+    printf("stats: %s\n", MasterMind::stats_enabled() ?
+           total.engine.Report().c_str() :
+           "compiled without statistics (MASTERMIND_STATS=0)");
+  printf("wall time %.2fs\n", seconds);
+  return 0;
+}
@@ -0,0 +1,306 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+#include <cassert>
+#include <atomic>
+#include <thread>
+using namespace std;
+
+#include "solver.h"
+
+// std::vector and std::atomic take it by reference
+const int Solver::kInfinity;
+
+Solver::Solver(const MasterMind& game, Objective objective,
+               size_t table_budget)
+    : game_(game), objective_(objective), table_(game.score_table()) {
+  if (game_.engine() == MasterMind::Engine::kLazy) {
+    table_ = nullptr;
+    return;
+  }
+  if (!table_)
+    table_ = game_.BuildScoreTable(table_budget);
+  if (!table_)
+    return;
+  game_.set_score_table(table_);
+  codes_.assign(game_.intent_candidates_begin(), game_.intent_candidates_end());
+  int num_positions = game_.num_positions();
+  num_results_ = (num_positions + 1) * (num_positions + 2) / 2;
+  all_black_ = table_->row(0)[0];
+  for (auto it = game_.target_candidates_begin();
+       it != game_.target_candidates_end(); ++it)
+    root_targets_.push_back(game_.CodeIndex(*it));
+
+  // Every intent finds at most one target, and splits the others into at
+  // most branching parts (all results but all black, and all but one black
+  // with one white, which doesn't occur), so at most branching^(d-1)
+  // targets can be found with the d-th intent.
+  int branching = num_results_ - 2;
+  size_t n = root_targets_.size();
+  lower_bound_.assign(n + 1, 0);
+  size_t found = 0, level_size = 1;
+  int total = 0;
+  for (int d = 1; found < n; d++) {
+    for (size_t k = 0; k < level_size && found < n; k++) {
+      found++;
+      total += d;
+      lower_bound_[found] =
+          objective_ == Objective::kExpectedGuesses ? total : d;
+    }
+    level_size = min(level_size * branching, n);
+  }
+}
+
+int Solver::IntentLowerBound(size_t n, const int* counter) const {
+  int cost = objective_ == Objective::kExpectedGuesses ? n : 1;
+  for (int r = 0; r < num_results_; r++) {
+    if (r != all_black_ && counter[r] > 0)
+      cost = Combine(cost, LowerBound(counter[r]));
+  }
+  return cost;
+}
+
+void Solver::Split(const Targets& targets, Code intent,
+                   vector<Targets>* parts) const {
+  const uint8_t* row = table_->row(intent);
+  vector<Targets> by_result(num_results_);
+  for (auto target: targets)
+    by_result[row[target]].push_back(target);
+  parts->clear();
+  for (int r = 0; r < num_results_; r++) {
+    if (r != all_black_ && !by_result[r].empty())
+      parts->push_back(move(by_result[r]));
+  }
+  stable_sort(parts->begin(), parts->end(),
+              [](const Targets& p1, const Targets& p2) {
+                return p1.size() > p2.size();
+              });
+}
+
+void Solver::OrderIntents(const Targets& targets, int depth, Context* context,
+                          vector<pair<int, Code>>* intents) const {
+  vector<int> representatives;
+  if (depth < kSymmetryDepth) {
+    context->game.IntentRepresentatives(&representatives);
+  } else {
+    representatives.resize(codes_.size());
+    for (size_t i = 0; i < codes_.size(); i++)
+      representatives[i] = i;
+  }
+  int n = targets.size();
+  intents->clear();
+  for (auto intent: representatives) {
+    const uint8_t* row = table_->row(intent);
+    int counter[kMaxResults] = {};
+    for (auto target: targets)
+      counter[row[target]]++;
+    // intents that don't split the targets don't get closer to them
+    if (counter[row[targets[0]]] == n && row[targets[0]] != all_black_)
+      continue;
+    intents->emplace_back(IntentLowerBound(n, counter), intent);
+  }
+  context->stats.intents += intents->size();
+  sort(intents->begin(), intents->end());
+}
+
+int Solver::SolveIntent(const Targets& targets, Code intent, int bound,
+                        int depth, Context* context) const {
+  vector<Targets> parts;
+  Split(targets, intent, &parts);
+  size_t n = targets.size();
+  int cost = objective_ == Objective::kExpectedGuesses ? n : 1;
+  // the lower bounds of the parts that haven't been solved yet
+  int rest = 0;
+  if (objective_ == Objective::kExpectedGuesses) {
+    for (auto& part: parts)
+      rest += LowerBound(part.size());
+  }
+  for (auto& part: parts) {
+    if (objective_ == Objective::kExpectedGuesses)
+      rest -= LowerBound(part.size());
+    int part_bound = objective_ == Objective::kExpectedGuesses ?
+        bound - cost - rest : bound - 1;
+    bool update = depth + 1 < kSymmetryDepth && part.size() > 2;
+    if (update) {
+      pair<int, int> evaluation =
+          game_.Evaluate(codes_[part[0]], codes_[intent]);
+      context->game.Update(codes_[intent], evaluation.first,
+                           evaluation.second);
+    }
+    Code part_intent;
+    int part_cost =
+        SolveTargets(part, part_bound, depth + 1, context, &part_intent);
+    if (update)
+      context->game.Undo();
+    cost = Combine(cost, part_cost);
+    if (cost + rest >= bound) {
+      context->stats.cutoffs++;
+      return cost + rest;
+    }
+  }
+  return cost;
+}
+
+int Solver::SolveTargets(const Targets& targets, int bound, int depth,
+                         Context* context, Code* best_intent) const {
+  size_t n = targets.size();
+  *best_intent = targets[0];
+  if (n <= 2)
+    return LowerBound(n);
+  context->stats.nodes++;
+  int lower = LowerBound(n);
+  if (lower >= bound)
+    return lower;
+  Memo::iterator entry = context->memo.end();
+  if (n >= kMinMemoTargets) {
+    entry = context->memo.find(targets);
+    if (entry != context->memo.end()) {
+      context->stats.memo_hits++;
+      if (entry->second.exact) {
+        *best_intent = entry->second.intent;
+        return entry->second.value;
+      }
+      if (entry->second.value >= bound)
+        return entry->second.value;
+      lower = max(lower, entry->second.value);
+    }
+  }
+
+  vector<pair<int, Code>> intents;
+  OrderIntents(targets, depth, context, &intents);
+  int best = bound;
+  // the least cost of the intents that couldn't beat best, all at least
+  // bound
+  int least = kInfinity;
+  bool found = false;
+  for (auto& intent: intents) {
+    if (intent.first >= best) {
+      least = min(least, intent.first);
+      break;
+    }
+    int cost = SolveIntent(targets, intent.second, best, depth, context);
+    if (cost < best) {
+      best = cost;
+      *best_intent = intent.second;
+      found = true;
+      if (best == lower)
+        break;
+    } else {
+      least = min(least, cost);
+    }
+  }
+
+  MemoEntry result = found ? MemoEntry{best, true, *best_intent} :
+      MemoEntry{least, false, 0};
+  if (entry != context->memo.end())
+    entry->second = result;
+  else if (n >= kMinMemoTargets && context->memo.size() < kMaxMemoEntries)
+    context->memo.emplace(targets, result);
+  return result.value;
+}
+
+int Solver::Solve() {
+  assert(ok());
+  stats_ = Stats();
+  Context root{game_, Memo(), Stats()};
+  size_t n = root_targets_.size();
+  if (n == 0) {
+    tree_.reset();
+    return 0;
+  }
+  if (n <= 2) {
+    Code intent;
+    int cost = SolveTargets(root_targets_, kInfinity, 0, &root, &intent);
+    tree_ = BuildTree(root_targets_, intent, 0, &root);
+    return cost;
+  }
+
+  // Distribute the intents of the root over the threads. An intent is
+  // solved with a bound one more than the best cost so far, so that all
+  // optimal intents get their exact cost, and the first of them in the
+  // order of OrderIntents is chosen whatever the number of threads.
+  vector<pair<int, Code>> intents;
+  OrderIntents(root_targets_, 0, &root, &intents);
+  int num_threads =
+      max(1, min(game_.num_threads(), static_cast<int>(intents.size())));
+  vector<Context> contexts(num_threads, Context{game_, Memo(), Stats()});
+  vector<int> costs(intents.size(), kInfinity);
+  vector<int> solved_by(intents.size(), -1);
+  atomic<size_t> next(0);
+  atomic<int> best(kInfinity - 1);
+  auto work = [&](int thread) {
+    for (size_t i = next++; i < intents.size(); i = next++) {
+      int bound = best.load();
+      if (intents[i].first > bound)
+        continue;
+      costs[i] = SolveIntent(root_targets_, intents[i].second, bound + 1, 0,
+                             &contexts[thread]);
+      solved_by[i] = thread;
+      while (costs[i] < bound &&
+             !best.compare_exchange_weak(bound, costs[i])) {}
+    }
+  };
+  vector<thread> threads;
+  for (int t = 1; t < num_threads; t++)
+    threads.emplace_back(work, t);
+  work(0);
+  for (auto& t: threads)
+    t.join();
+
+  size_t chosen = min_element(costs.begin(), costs.end()) - costs.begin();
+  stats_ = root.stats;
+  for (auto& context: contexts) {
+    stats_.nodes += context.stats.nodes;
+    stats_.memo_hits += context.stats.memo_hits;
+    stats_.intents += context.stats.intents;
+    stats_.cutoffs += context.stats.cutoffs;
+  }
+  // The memo of the thread that solved the chosen intent has the exact
+  // costs of its subtrees.
+  tree_ = BuildTree(root_targets_, intents[chosen].second, 0,
+                    &contexts[solved_by[chosen]]);
+  return costs[chosen];
+}
+
+unique_ptr<Solver::Node> Solver::BuildTree(const Targets& targets, Code intent,
+                                           int depth, Context* context) const {
+  unique_ptr<Node> node(new Node);
+  node->intent = codes_[intent];
+  node->num_targets = targets.size();
+  vector<Targets> parts;
+  Split(targets, intent, &parts);
+  for (auto& part: parts) {
+    pair<int, int> evaluation =
+        game_.Evaluate(codes_[part[0]], codes_[intent]);
+    bool update = depth + 1 < kSymmetryDepth;
+    if (update)
+      context->game.Update(codes_[intent], evaluation.first,
+                           evaluation.second);
+    Code part_intent;
+    SolveTargets(part, kInfinity, depth + 1, context, &part_intent);
+    node->children.emplace_back(
+        evaluation, BuildTree(part, part_intent, depth + 1, context));
+    if (update)
+      context->game.Undo();
+  }
+  sort(node->children.begin(), node->children.end(),
+       [](const pair<pair<int, int>, unique_ptr<Node>>& c1,
+          const pair<pair<int, int>, unique_ptr<Node>>& c2) {
+         return c1.first < c2.first;
+       });
+  return node;
+}
+
+void Solver::PrintNode(ostream& out, const Node& node, int depth) const {
+  out << game_.cc2string(node.intent) << " " << node.num_targets << "\n";
+  for (auto& child: node.children) {
+    out << string(2 * (depth + 1), ' ') << child.first.first << " "
+        << child.first.second << " ";
+    PrintNode(out, *child.second, depth + 1);
+  }
+}
+
+void Solver::PrintTree(ostream& out) const {
+  if (tree_)
+    PrintNode(out, *tree_, 0);
+}
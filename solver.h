@@ -0,0 +1,178 @@
+// -*- eval: (google-set-c-style) -*-
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mastermind.h"
+
+// Computes an optimal strategy for a game, as opposed to the greedy choice
+// of maximal entropy of MasterMind::ChooseIntent, by searching the whole
+// game tree:
+// - kExpectedGuesses minimizes the total number of intents needed to find
+//   every possible target (i.e. the expected number, with all targets equally
+//   likely)
+// - kMinimax minimizes the number of intents needed in the worst case
+// The search is a depth first branch and bound: the intents of a set of
+// possible targets are tried in increasing order of a lower bound of their
+// cost, which only depends on the sizes of the parts of their partition,
+// and abandoned as soon as they can't beat the best one so far. The results
+// of sets of possible targets are memoized, so that sets reached along
+// several paths are only solved once, and on the first kSymmetryDepth
+// levels only one intent of every orbit of the symmetries of the game is
+// tried (see MasterMind::IntentRepresentatives). The intents of the root
+// are distributed over threads, each with its own memo.
+//
+// Needs the score table, so it's for games up to a few thousand codes,
+// e.g. 6 colors and 4 positions.
+class Solver {
+ public:
+  enum class Objective { kExpectedGuesses, kMinimax };
+
+  // A node of the decision tree: the intent to play when the possible
+  // targets are the num_targets ones consistent with the evaluations on the
+  // path to it, and the subtree for every evaluation other than all black.
+  struct Node {
+    MasterMind::ColorComb intent;
+    int num_targets;
+    std::vector<std::pair<std::pair<int, int>, std::unique_ptr<Node>>>
+        children;
+  };
+
+  struct Stats {
+    // the sets of targets that were searched, and the ones found in a memo
+    uint64_t nodes = 0;
+    uint64_t memo_hits = 0;
+    // the intents whose partition was computed, and the ones of those that
+    // were abandoned without solving all parts
+    uint64_t intents = 0;
+    uint64_t cutoffs = 0;
+  };
+
+  // By default the score table may take this many bytes, e.g. up to 6
+  // colors and 5 positions.
+  static const size_t kDefaultTableBudget = size_t(256) << 20;
+
+  // Solves the game from its current state (usually the initial one). Uses
+  // the score table of the game, or builds one of at most table_budget
+  // bytes. If the game is too large for that, or uses the lazy engine,
+  // which doesn't store the codes, ok() is false.
+  Solver(const MasterMind& game, Objective objective,
+         size_t table_budget = kDefaultTableBudget);
+  bool ok() const { return table_ != nullptr; }
+
+  // Searches the optimal strategy and returns its cost: the total number of
+  // intents over all possible targets, or the maximal number. Needs ok().
+  int Solve();
+
+  // After Solve, if there were possible targets: the decision tree of the
+  // optimal strategy.
+  const Node& tree() const { return *tree_; }
+  const Stats& stats() const { return stats_; }
+
+  // Writes the tree, one line per node with the evaluation leading to it,
+  // the intent, and the number of possible targets, indented by its depth.
+  // Writes nothing if there were no possible targets.
+  void PrintTree(std::ostream& out) const;
+
+ private:
+  // Intents are only reduced by the symmetries in the root and its children:
+  // there are few symmetries left deeper, and finding them takes longer
+  // than just trying all intents.
+  static const int kSymmetryDepth = 2;
+  // Sets of fewer targets are solved again instead of looked up.
+  static const size_t kMinMemoTargets = 3;
+  // A memo stops growing at this size, to bound the memory.
+  static const size_t kMaxMemoEntries = size_t(1) << 22;
+  static const int kInfinity = 1 << 30;
+  static const int kMaxResults =
+      (MasterMind::kMaxPositions + 1) * (MasterMind::kMaxPositions + 2) / 2;
+
+  // Codes are CodeIndex, sets of targets are sorted vectors of those.
+  using Code = uint32_t;
+  using Targets = std::vector<Code>;
+
+  struct TargetsHash {
+    size_t operator()(const Targets& targets) const {
+      uint64_t hash = targets.size();
+      for (auto target: targets)
+        hash = (hash ^ target) * 0x9E3779B97F4A7C15;
+      return hash ^ (hash >> 32);
+    }
+  };
+
+  // If exact, value is the cost of the set and intent the one achieving it,
+  // otherwise value is a lower bound of the cost.
+  struct MemoEntry {
+    int value;
+    bool exact;
+    Code intent;
+  };
+  using Memo = std::unordered_map<Targets, MemoEntry, TargetsHash>;
+
+  // The state of a search on one thread: a copy of the game that follows
+  // the first kSymmetryDepth levels for the symmetries, and the memo.
+  struct Context {
+    MasterMind game;
+    Memo memo;
+    Stats stats;
+  };
+
+  // The cost of solving n targets if every intent split the remaining ones
+  // into the most parts possible.
+  int LowerBound(size_t n) const { return lower_bound_[n]; }
+  // The cost of intent given the sizes of the parts of its partition, with
+  // the parts replaced by their LowerBound.
+  int IntentLowerBound(size_t n, const int* counter) const;
+  // The cost of intent given the costs of the parts of its partition
+  // (except all black) so far, and the total so far.
+  int Combine(int total, int part_cost) const {
+    return objective_ == Objective::kExpectedGuesses ? total + part_cost :
+        std::max(total, 1 + part_cost);
+  }
+
+  // Returns the cost of targets if it is less than bound, or else some
+  // lower bound of it that is at least bound. depth is the number of
+  // intents so far, context->game has been updated with them while depth
+  // <= kSymmetryDepth.
+  int SolveTargets(const Targets& targets, int bound, int depth,
+                   Context* context, Code* best_intent) const;
+  // The cost of intent for targets, or a lower bound of it that is at least
+  // bound, like SolveTargets.
+  int SolveIntent(const Targets& targets, Code intent, int bound, int depth,
+                  Context* context) const;
+
+  // The intents to try for targets, in increasing order of IntentLowerBound,
+  // which is set in the first of the pairs.
+  void OrderIntents(const Targets& targets, int depth, Context* context,
+                    std::vector<std::pair<int, Code>>* intents) const;
+
+  // Splits targets by the result of intent, into the parts other than all
+  // black, in decreasing order of size.
+  void Split(const Targets& targets, Code intent,
+             std::vector<Targets>* parts) const;
+
+  std::unique_ptr<Node> BuildTree(const Targets& targets, Code intent,
+                                  int depth, Context* context) const;
+  void PrintNode(std::ostream& out, const Node& node, int depth) const;
+
+  MasterMind game_;
+  Objective objective_;
+  std::shared_ptr<const ScoreTable> table_;
+  // the codes in CodeIndex order
+  std::vector<MasterMind::ColorComb> codes_;
+  int num_results_;
+  int all_black_;
+  std::vector<int> lower_bound_;
+  Targets root_targets_;
+
+  std::unique_ptr<Node> tree_;
+  Stats stats_;
+};
+
+#endif // SOLVER_H_
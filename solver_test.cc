@@ -0,0 +1,159 @@
+// -*- eval: (google-set-c-style) -*-
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "mastermind.h"
+#include "solver.h"
+
+namespace {
+
+// The optimal cost of the targets by trying every intent in every state,
+// for games small enough
+class ExhaustiveSolver {
+ public:
+  ExhaustiveSolver(const MasterMind& game, Solver::Objective objective)
+      : game_(game), objective_(objective),
+        codes_(game.target_candidates_begin(), game.target_candidates_end()) {}
+
+  int Solve(const vector<MasterMind::ColorComb>& targets) {
+    if (targets.size() == 1)
+      return 1;
+    auto it = memo_.find(targets);
+    if (it != memo_.end())
+      return it->second;
+    int best = -1;
+    for (auto intent: codes_) {
+      map<pair<int, int>, vector<MasterMind::ColorComb>> parts;
+      for (auto target: targets)
+        parts[game_.Evaluate(target, intent)].push_back(target);
+      // no progress
+      if (parts.begin()->second.size() == targets.size() &&
+          parts.begin()->first.first != game_.num_positions())
+        continue;
+      int cost = objective_ == Solver::Objective::kMinimax ? 1 :
+          targets.size();
+      for (auto& part: parts) {
+        if (part.first.first == game_.num_positions())
+          continue;
+        if (objective_ == Solver::Objective::kMinimax)
+          cost = max(cost, 1 + Solve(part.second));
+        else
+          cost += Solve(part.second);
+      }
+      if (best < 0 || cost < best)
+        best = cost;
+    }
+    memo_[targets] = best;
+    return best;
+  }
+
+  int Solve() { return Solve(codes_); }
+
+ private:
+  const MasterMind& game_;
+  Solver::Objective objective_;
+  vector<MasterMind::ColorComb> codes_;
+  map<vector<MasterMind::ColorComb>, int> memo_;
+};
+
+// Plays every target by the tree, and returns the total number of intents,
+// or the maximal one for kMinimax
+int PlayTree(const MasterMind& game, const Solver& solver,
+             Solver::Objective objective) {
+  int total = 0, worst = 0;
+  for (auto t = game.target_candidates_begin();
+       t != game.target_candidates_end(); ++t) {
+    const Solver::Node* node = &solver.tree();
+    int guesses = 1;
+    while (node->intent != *t) {
+      auto bw = game.Evaluate(*t, node->intent);
+      const Solver::Node* next = nullptr;
+      for (auto& child: node->children) {
+        if (child.first == bw)
+          next = child.second.get();
+      }
+      if (!next) {
+        ADD_FAILURE() << game.cc2string(*t) << " not found";
+        return -1;
+      }
+      node = next;
+      guesses++;
+    }
+    total += guesses;
+    worst = max(worst, guesses);
+  }
+  return objective == Solver::Objective::kMinimax ? worst : total;
+}
+
+TEST(SolverTest, MatchesExhaustiveSearch) {
+  for (auto configuration: vector<pair<string, int>>{
+           {"rgb", 2}, {"rgby", 2}, {"rg", 3}, {"rgb", 3}}) {
+    MasterMind game(configuration.first, configuration.second);
+    for (auto objective: {Solver::Objective::kExpectedGuesses,
+                          Solver::Objective::kMinimax}) {
+      Solver solver(game, objective);
+      int cost = solver.Solve();
+      EXPECT_EQ(ExhaustiveSolver(game, objective).Solve(), cost)
+          << configuration.first << " " << configuration.second;
+      EXPECT_EQ(cost, PlayTree(game, solver, objective));
+    }
+  }
+}
+
+// The optimum is at least as good as the greedy choice
+TEST(SolverTest, BeatsEntropy) {
+  MasterMind game("rgbyo", 3);
+  Solver solver(game, Solver::Objective::kExpectedGuesses);
+  int cost = solver.Solve();
+  EXPECT_EQ(cost, PlayTree(game, solver,
+                           Solver::Objective::kExpectedGuesses));
+  int greedy = 0;
+  for (auto t = game.target_candidates_begin();
+       t != game.target_candidates_end(); ++t) {
+    MasterMind play(game);
+    MasterMind::ColorComb intent = play.InitialIntent(
+        play.ChooseInitialIntent());
+    greedy++;
+    while (intent != *t) {
+      auto bw = play.Evaluate(*t, intent);
+      play.Update(intent, bw.first, bw.second);
+      intent = play.num_candidates() == 1 ?
+          *play.target_candidates_begin() : play.ChooseIntent();
+      greedy++;
+    }
+  }
+  EXPECT_LE(cost, greedy);
+}
+
+// Games whose score table doesn't fit in the budget aren't solved, and
+// without possible targets there is no tree to print
+TEST(SolverTest, Limits) {
+  MasterMind game("rgbyop", 4);
+  EXPECT_FALSE(Solver(game, Solver::Objective::kExpectedGuesses, 1000).ok());
+  game.Update(game.string2cc("rgby"), 1, 1);
+  game.Update(game.string2cc("rrrr"), 4, 0);
+  Solver solver(game, Solver::Objective::kMinimax);
+  ASSERT_TRUE(solver.ok());
+  EXPECT_EQ(0, solver.Solve());
+  ostringstream out;
+  solver.PrintTree(out);
+  EXPECT_EQ("", out.str());
+}
+
+TEST(SolverTest, Lazy) {
+  MasterMind lazy("rgbyop", 4, MasterMind::Engine::kLazy);
+  EXPECT_FALSE(Solver(lazy, Solver::Objective::kMinimax).ok());
+  // Not even once the targets are generated, as the codes never are
+  lazy.Update(lazy.string2cc("rrgb"), 1, 1);
+  EXPECT_FALSE(Solver(lazy, Solver::Objective::kMinimax).ok());
+}
+
+}  // namespace